@@ -1,13 +1,22 @@
 #include "app.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
 //#include <time.h>
 #include <math.h>
-#include <sys/time.h>
 
 #include "display.h"
+#include "scene.h"
+#include "frame_scheduler.h"
 #include "keyboard.h"
+#include "key_ring.h"
+#include "latency_histogram.h"
 #include "epoll_timerfd_utilities.h"
+#include "gpio_port.h"
+#include "lock_actuator.h"
+#include "state_machine.h"
+#include "code_store.h"
 #include <applibs/log.h>
 #include <applibs/gpio.h>
 
@@ -29,15 +38,23 @@ enum appStateEnum {
 	INVALID_CREDENTIALS,
 	DONE,
 	ERROR,
-	DRAWER_LOCKED
+	DRAWER_LOCKED,
+	LOCK_FAILED,
+	APP_STATE_COUNT
 };
 
-enum actionEnum {
-	NOTHING,
-	NEXT_SCREEN,
-	PREVIOUS_SCREEN,
-	ADD_TO_VALUE,
-	REMOVE_FROM_VALUE
+enum appEventEnum {
+	EVENT_KEY_A,
+	EVENT_KEY_B,
+	EVENT_KEY_CONFIRM,
+	EVENT_KEY_BACK,
+	EVENT_KEY_DIGIT,
+	EVENT_KEY_DELETE,
+	EVENT_LOCK_OPENED,
+	EVENT_LOCK_CLOSED,
+	EVENT_TIMEOUT,
+	EVENT_UNLOCK_FAILED,
+	EVENT_COUNT
 };
 
 enum lockStateEnum {
@@ -45,26 +62,120 @@ enum lockStateEnum {
 	LOCK_CLOSED = GPIO_Value_Low
 };
 
+/**
+* Pins of a compartment.
+*/
+struct compartmentPins {
+	int lockPin; /**< Servo of the lock. */
+	int sensorPin; /**< Door sensor, high while the door is open. */
+};
+
+/**
+* State of a compartment, kept apart from the UI session shared by all compartments.
+*/
+struct compartment {
+	enum lockStateEnum lockState; /**< Last state reported by the door sensor. */
+	bool isEmpty;
+};
+
+/**
+* UI session, the keypad and display are shared by all compartments.
+*/
 struct appStateContainer {
 	enum appStateEnum appState;
 	enum operationTypeEnum operationType;
-	enum lockStateEnum lockState;
-	bool isKeyPressed;
+	int compartment; /**< Compartment the session opens, -1 until a code chose one. */
 	bool redrawRequired;
-	bool isReopen;
 	bool isValidationSuccessful;
-	bool isEmpty;
 	uint8_t wrongAttempts;
+	uint8_t lockouts; /**< Lockouts since the last valid code, every one lasts twice as long as the previous one. */
 	bool alert;
 };
 
-static char secretCode[7] =  "";
-static char savedCode[7] = "";
+static struct appStateContainer currentAppState;
+static struct stateMachine appMachine; /*!< Drives currentAppState.appState, see appMachineDefinition. */
+static bool hasEventFailed = false; /*!< Set if an action or hook failed outside runApp(), reported by its next call. */
+
+static int dispatchAppEvent(enum appEventEnum event, int argument);
+
+static const int frameRate = 25; /*!< Maximum number of screens presented per second. */
+
+static int presentApp();
+
+#ifndef LATENCY_REPORT_PERIOD_SECONDS
+#define LATENCY_REPORT_PERIOD_SECONDS 3600 /*!< How often input latency percentiles are logged and sent, 0 disables reports. */
+#endif
+
+#ifndef SEND_LATENCY_TELEMETRY
+#define SEND_LATENCY_TELEMETRY 1 /*!< Set to 0 to only log latency reports instead of sending them as telemetry. */
+#endif
+
+static struct latencyHistogram keyToInputLatency = { .name = "KeyToInputUs" }; /*!< From key going down to the app taking it. */
+static struct latencyHistogram keyToActionLatency = { .name = "KeyToActionUs" }; /*!< From key going down to the app acting on it. */
+static struct latencyHistogram keyToPixelLatency = { .name = "KeyToPixelUs" }; /*!< From key going down to its screen being on the display. */
+static struct timespec unpresentedKeyAt; /*!< When the oldest key not presented yet went down. */
+static bool hasUnpresentedKey = false; /*!< True if a key changed the app and its frame wasn't presented yet. */
+static struct timespec renderingKeyAt; /*!< When the key of the frame being rendered went down. */
+static bool isRenderingKey = false; /*!< True while the render thread sends a frame showing a key. */
+static int latencyTimerFd = -1; /*!< Periodic timer of latency reports. */
+
+#ifndef MAX_WRONG_ATTEMPTS
+#define MAX_WRONG_ATTEMPTS 3 /*!< Wrong codes in a row that lock the drawer. */
+#endif
+
+static int invalidCodeMs = 3000; /*!< Time invalid code screen is shown. */
+static int lockoutSeconds = 60; /*!< Duration of the first lockout. */
+static int maxLockoutSeconds = 3600; /*!< Lockouts stop doubling at this duration. */
+static int timedStateTimerFd = -1; /*!< Single expiry timer ending invalid credentials and drawer locked states. */
+
+static char secretCode[CODE_LENGTH + 1] =  "";
+
+#ifndef LOCK_ACTUATOR_DRIVER
+#define LOCK_ACTUATOR_DRIVER LOCK_ACTUATOR_THREAD /*!< How lock servo pulses are generated. */
+#endif
+
+#define LOCK_OPEN_PULSE_US 1900 /*!< Servo pulse width of the open position. */
+#define LOCK_CLOSED_PULSE_US 1000 /*!< Servo pulse width of the closed position. */
+#define LOCK_OPEN_TIMEOUT_MS 500 /*!< Longest time the servo is driven to open before the attempt fails. */
+#define LOCK_OPEN_ATTEMPTS 3 /*!< Open attempts before the lock is reported as failed. */
+#define LOCK_RETRY_BACKOFF_MS 200 /*!< Time the servo is driven back to closed between attempts. */
+#define LOCK_CLOSE_MS 500 /*!< Time the servo is driven back to closed. */
+
+/**
+* Lock and sensor pins of every compartment, compartments are numbered from 0 in this order.
+*/
+static const struct compartmentPins compartmentPins[] = {
+	{ 0, 27 },
+};
+
+#define COMPARTMENT_COUNT ((int)(sizeof(compartmentPins) / sizeof(compartmentPins[0])))
+#define SENSOR_PORT_COUNT ((COMPARTMENT_COUNT + GPIO_PORT_MAX_PINS - 1) / GPIO_PORT_MAX_PINS)
+
+_Static_assert(COMPARTMENT_COUNT <= LOCK_ACTUATOR_MAX_LOCKS, "lock actuator can't drive every compartment");
+_Static_assert(COMPARTMENT_COUNT * 2 <= CODE_STORE_SLOTS, "code store can't keep a code for every compartment, raise CODE_STORE_BITS");
+
+static struct compartment compartments[COMPARTMENT_COUNT];
+static struct gpioPort sensorPorts[SENSOR_PORT_COUNT]; /*!< Door sensors, compartment n is bit n % GPIO_PORT_MAX_PINS of port n / GPIO_PORT_MAX_PINS. */
+
+#define SENSOR_POLL_MS 10 /*!< Door sensor poll period while a door is expected to move, sensors are polled only without edge events. */
+#define SENSOR_IDLE_POLL_MS 250 /*!< Door sensor poll period otherwise, only doors forced open are noticed then. */
+#define APP_TICK_MS 10 /*!< Delay of work runApp() leaves for later, keys behind a new screen and prerendering. */
 
-static const int lockPin = 0;
-static const int lockStatePin = 27;
-static int lockPinFd = -1;
-static int lockStatePinFd = -1;
+static int sensorTimerFd = -1; /*!< Periodic door sensor poll, -1 if every sensor port reports edges. */
+static int tickTimerFd = -1; /*!< Single expiry timer waking the loop for work runApp() left for later. */
+static struct codeStore codeStore; /*!< Codes of occupied compartments. */
+
+/**
+* Store or pick up waiting for the lock of its compartment to open.
+*/
+struct compartmentChange {
+	bool isPending; /**< True from a confirmed code until the lock opened or the session went back to select. */
+	enum operationTypeEnum operationType; /**< Whether the code is stored or removed. */
+	int compartment; /**< Compartment that gets occupied or emptied. */
+	char code[CODE_LENGTH + 1]; /**< Code of the compartment. */
+};
+
+static struct compartmentChange pendingChange; /*!< Applied once the door sensor reports the compartment open, an unlock that fails leaves the compartment as it was. */
 
 static bool stateChanged(enum appStateEnum currentState)
 {
@@ -79,439 +190,780 @@ static bool stateChanged(enum appStateEnum currentState)
 	return false;
 }
 
-static void saveSecretCode()
+/**
+* Read every door sensor and pass doors that changed to the app, one port read covers up to GPIO_PORT_MAX_PINS doors.
+*/
+static void pollDoorSensors()
 {
-	strcpy(savedCode, secretCode);
-}
-
-static bool lockStateChanged(enum lockStateEnum* state)
-{
-	static GPIO_Value_Type previousState = GPIO_Value_Low;
+	for (int port = 0; port < SENSOR_PORT_COUNT; port++)
+	{
+		int first = port * GPIO_PORT_MAX_PINS;
+		uint8_t value;
+		if (readGpioPort(&sensorPorts[port], 0xFF, &value) < 0)
+			continue;//sensors of the port are read again on the next poll or edge
 
-	GPIO_Value_Type lockState;
-	int result = GPIO_GetValue(lockStatePinFd, &lockState);
-	if (result < 0)
-		return -1;
+		for (int pin = 0; pin < sensorPorts[port].pinCount; pin++)
+		{
+			struct compartment* compartment = &compartments[first + pin];
+			enum lockStateEnum lockState = (value >> pin) & 1 ? LOCK_OPEN : LOCK_CLOSED;
+			if (lockState == compartment->lockState)
+				continue;
 
-	if (lockState != previousState)
-	{
-		*state = lockState;
-		previousState = lockState;
-		return true;
+			compartment->lockState = lockState;
+			dispatchAppEvent(lockState == LOCK_OPEN ? EVENT_LOCK_OPENED : EVENT_LOCK_CLOSED, first + pin);
+		}
 	}
-
-	return false;
 }
 
 static void clearSecretCode()
 {
-	for (int i = 0; i < 6; i++)
+	for (int i = 0; i < CODE_LENGTH; i++)
 		secretCode[i] = '\0';
 }
 
-int initApp()
+/**
+* Render thread finished a frame, hand over anything drawn in the meantime.
+*/
+static void renderEventHandler(EventData* eventData)
 {
-	lockPinFd = GPIO_OpenAsOutput(lockPin, GPIO_OutputMode_OpenDrain, GPIO_Value_High);
-	if (lockPinFd < 0)
-		return -1;
+	//failure is reported by next flushDisplay() in runApp()
+	acknowledgeRenderCompletion();
+	frameRenderCompleted();
 
-	lockStatePinFd = GPIO_OpenAsInput(lockStatePin);
-	if (lockStatePinFd < 0)
-		return -1;
+	if (isRenderingKey)
+	{
+		recordLatencySince(&keyToPixelLatency, &renderingKeyAt);
+		isRenderingKey = false;
+	}
+}
 
-	int result = initDisplay();
-	if (result < 0)
-		return -1;
+/**
+* Log percentiles of input latencies and presses lost since the last report, send them as telemetry and start collecting anew.
+*/
+static void reportLatencies()
+{
+	static unsigned reportedDroppedKeys = 0;
+	unsigned droppedKeys = getDroppedKeyCount();
+	if (droppedKeys != reportedDroppedKeys)
+	{
+		char dropped[16];
+		snprintf(dropped, sizeof(dropped), "%u", droppedKeys - reportedDroppedKeys);
+		Log_Debug("DroppedKeys: %s\n", dropped);
+		if (SEND_LATENCY_TELEMETRY)
+			SendTelemetry((const unsigned char*)"DroppedKeys", (const unsigned char*)dropped);
+		reportedDroppedKeys = droppedKeys;
+	}
 
-	result = initKeyboard();
-	if (result < 0)
-		return -1;
+	struct latencyHistogram* histograms[] = { &keyToInputLatency, &keyToActionLatency, &keyToPixelLatency };
+	for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++)
+	{
+		char summary[128];//fits four longs and the count
+		if (getLatencyCount(histograms[i]) == 0)
+			continue;
 
-	return 0;
+		if (formatLatencySummary(histograms[i], summary, sizeof(summary)) < 0)
+			Log_Debug("ERROR: %s summary doesn't fit, dropping it.\n", histograms[i]->name);
+		else
+		{
+			Log_Debug("%s: %s\n", histograms[i]->name, summary);
+			if (SEND_LATENCY_TELEMETRY)
+				SendTelemetry((const unsigned char*)histograms[i]->name, (const unsigned char*)summary);
+		}
+		resetLatencyHistogram(histograms[i]);
+	}
 }
 
-void cleanupApp()
+static void latencyTimerEventHandler(EventData* eventData)
 {
-	CloseFdAndPrintError(lockPinFd, "Lock pin");
-	cleanupDisplay();
-	cleanupKeyboard();
-}
+	if (ConsumeTimerFdEvent(latencyTimerFd) != 0)
+		return;
 
-static bool isValidCode()
-{
-	if (!strcmp(secretCode, savedCode))
-		return true;
-	return false;
+	reportLatencies();
 }
 
-static int setPulse(int uS)
+static EventData latencyEventData = { .eventHandler = &latencyTimerEventHandler };
+
+static void timedStateTimerEventHandler(EventData* eventData)
 {
-	struct timespec sleepTime = { 0, uS*1000 };
-	int result = GPIO_SetValue(lockPinFd, GPIO_Value_High);
-	if (result < 0)
-		return -1;
-	nanosleep(&sleepTime, NULL);
+	if (ConsumeTimerFdEvent(timedStateTimerFd) != 0)
+		return;
 
-	sleepTime.tv_nsec = 20 * 1000 * 1000 - uS * 1000;
-	result = GPIO_SetValue(lockPinFd, GPIO_Value_Low);
-	if (result < 0)
-		return -1;
-	nanosleep(&sleepTime, NULL);
+	dispatchAppEvent(EVENT_TIMEOUT, 0);
 }
 
-static long getTimeMs()
+static EventData timedStateEventData = { .eventHandler = &timedStateTimerEventHandler };
+
+/**
+* Key was pressed, runApp() takes it once this handler returns.
+*/
+static void keyEventHandler(EventData* eventData)
 {
-	struct timeval te;
-	gettimeofday(&te, NULL); // get current time
-	long long milliseconds = te.tv_sec * 1000LL + te.tv_usec / 1000; // calculate milliseconds
-	// printf("milliseconds: %lld\n", milliseconds);
-	return milliseconds;
+	if (consumeKeyEvents() < 0)
+		hasEventFailed = true;
 }
 
-static int unlock()
+/**
+* Door sensor changed on a port reporting edges.
+*/
+static void sensorEventHandler(EventData* eventData)
 {
-	long start = getTimeMs();
-	long now = start;
-	while (now - start < 500)
+	for (int port = 0; port < SENSOR_PORT_COUNT; port++)
 	{
-		now = getTimeMs();
-		if (setPulse(1900) < 0)
-			return -1;
+		if (consumeGpioPortEvents(&sensorPorts[port]) < 0)
+			hasEventFailed = true;
 	}
 
-	start = getTimeMs();
-	now = start;
-	while (now - start < 500)
-	{
-		now = getTimeMs();
-		if (setPulse(1000) < 0)
-			return -1;
-	}
+	pollDoorSensors();
 }
 
-static enum actionEnum keyToAction(char key)
+static void sensorTimerEventHandler(EventData* eventData)
 {
-	switch (key)
+	if (ConsumeTimerFdEvent(sensorTimerFd) != 0)
 	{
-	case '!':
-	case '#':
-	case 'A':
-	case 'B':
-		return NEXT_SCREEN;
-		break;
-	case '*':
-		return PREVIOUS_SCREEN;
-		break;
-	case 'D':
-		return REMOVE_FROM_VALUE;
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':
-	case '0':
-		return ADD_TO_VALUE;
-		break;
+		hasEventFailed = true;
+		return;
 	}
-	return NOTHING;
+
+	pollDoorSensors();
 }
 
-static int drawSelect(bool isEmpty)
+/**
+* Work left by runApp() is due, runApp() does it once this handler returns.
+*/
+static void tickTimerEventHandler(EventData* eventData)
 {
+	if (ConsumeTimerFdEvent(tickTimerFd) != 0)
+		hasEventFailed = true;
+}
 
-	int result = fillScreen(0xba9b02);
-	if (result < 0)
-		return -1;
-
-	result = drawLine(0, 15, 95, 15, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+static EventData keyEventData = { .eventHandler = &keyEventHandler };
+static EventData sensorEventData = { .eventHandler = &sensorEventHandler };
+static EventData sensorTimerEventData = { .eventHandler = &sensorTimerEventHandler };
+static EventData tickTimerEventData = { .eventHandler = &tickTimerEventHandler };
 
-	if (isEmpty)
-	{
-		result = drawText("Drawer is empty", 5, 5, 0xFFFFFF);
-		if (result < 0)
-			return -1;
-
-		result = drawText("A. store", 25, 30, 0xFFFFFF);
-		if (result < 0)
-			return -1;
-	}
-	else
-	{
-		result = drawText("Drawer is occupied", 5, 5, 0xFFFFFF);
-		if (result < 0)
-			return -1;
+/**
+* Check if a door may open or close any moment in given state, sensors are polled faster then.
+*/
+static bool isDoorExpected(enum appStateEnum state)
+{
+	return state == WAIT || state == OPEN || state == LOCK_FAILED;
+}
 
-		result = drawText("A. pick up", 25, 30, 0xFFFFFF);
-		if (result < 0)
-			return -1;
-	}
+/**
+* Set door sensor poll period for given state, nothing is done if sensors report edges.
+*
+* @return 0 or -1 if something went wrong.
+*/
+static int armSensorTimer(enum appStateEnum state)
+{
+	if (sensorTimerFd < 0)
+		return 0;
 
-	return 0;
+	int ms = isDoorExpected(state) ? SENSOR_POLL_MS : SENSOR_IDLE_POLL_MS;
+	const struct timespec period = { ms / 1000, (ms % 1000) * 1000000L };
+	return SetTimerFdToPeriod(sensorTimerFd, &period);
 }
 
-static int drawCode(bool redrawAll)
+static EventData renderEventData = { .eventHandler = &renderEventHandler };
+
+int initApp(int epollFd)
 {
-	int result;
-	if (redrawAll)
+	int lockPins[COMPARTMENT_COUNT];
+	int sensorPins[COMPARTMENT_COUNT];
+	for (int i = 0; i < COMPARTMENT_COUNT; i++)
 	{
-		result = fillScreen(0xba9b02);
-		if (result < 0)
-			return -1;
-
-		result = drawText("Type your", 5, 5, 0xFFFFFF);
-		if (result < 0)
-			return -1;
-
-		result = drawText("6-digits code", 5, 15, 0xFFFFFF);
-		if (result < 0)
-			return -1;
+		lockPins[i] = compartmentPins[i].lockPin;
+		sensorPins[i] = compartmentPins[i].sensorPin;
+		compartments[i].lockState = LOCK_CLOSED;
+		compartments[i].isEmpty = true;
+	}
+	initCodeStore(&codeStore);
 
-		result = drawLine(0, 23, 95, 23, 0xFFFFFF);
-		if (result < 0)
-			return -1;
+	if (initLockActuator(epollFd, LOCK_ACTUATOR_DRIVER, lockPins, COMPARTMENT_COUNT) < 0)
+		return -1;
 
-		result = drawText(secretCode, 15, 35, 0xFFFFFF);
-		if (result < 0)
+	//doors are polled only if some port can't report edges
+	bool isSensorPolled = false;
+	for (int port = 0; port < SENSOR_PORT_COUNT; port++)
+	{
+		int first = port * GPIO_PORT_MAX_PINS;
+		int count = COMPARTMENT_COUNT - first < GPIO_PORT_MAX_PINS ? COMPARTMENT_COUNT - first : GPIO_PORT_MAX_PINS;
+		if (openGpioPort(&sensorPorts[port], GPIO_DRIVER, &sensorPins[first], count, GPIO_PORT_EDGE_EVENTS, 0) < 0)
 			return -1;
 
-		result = drawLine(10, 45, 85, 45, 0x36342e);
-		if (result < 0)
+		int sensorEventFd = getGpioPortEventFd(&sensorPorts[port]);
+		if (sensorEventFd < 0)
+			isSensorPolled = true;
+		else if (RegisterEventHandlerToEpoll(epollFd, sensorEventFd, &sensorEventData, EPOLLIN) < 0)
 			return -1;
 	}
-	else {
-		result = drawRectangle(15, 35, 85, 8, 0xba9b02, 1, 0xba9b02);
-		if (result < 0)
-			return -1;
 
-		result = drawText(secretCode, 15, 35, 0xFFFFFF);
-		if (result < 0)
+	if (isSensorPolled)
+	{
+		const struct timespec disarmed = { 0, 0 };
+		sensorTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &disarmed, &sensorTimerEventData, EPOLLIN);
+		if (sensorTimerFd < 0 || armSensorTimer(SELECT) < 0)
 			return -1;
 	}
-}
 
-static int drawOpen()
-{
-	int result = fillScreen(0xba9b02);
+	int result = initDisplay();
 	if (result < 0)
 		return -1;
 
-	result = drawText("Locker is now", 5, 5, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+	setFramebufferMode(true);
 
-	result = drawText("open", 5, 15, 0xFFFFFF);
+	//UI uses a handful of colors, 256 color mode halves every flush
+	result = setColorDepth(8);
 	if (result < 0)
 		return -1;
 
-	result = drawLine(0, 23, 95, 23, 0xFFFFFF);
-	if (result < 0)
+	//paint from a separate thread so slow screens don't delay keypad and sensor handling
+	int renderEventFd = startRenderThread();
+	if (renderEventFd < 0)
 		return -1;
-}
 
-static int drawClosed()
-{
-	int result = fillScreen(0xba9b02);
+	result = RegisterEventHandlerToEpoll(epollFd, renderEventFd, &renderEventData, EPOLLIN);
 	if (result < 0)
 		return -1;
 
-	result = drawText("Locker is now", 5, 5, 0xFFFFFF);
+	result = initKeyboard();
 	if (result < 0)
 		return -1;
 
-	result = drawText("closed", 5, 15, 0xFFFFFF);
+	result = RegisterEventHandlerToEpoll(epollFd, getKeyEventFd(), &keyEventData, EPOLLIN);
 	if (result < 0)
 		return -1;
 
-	result = drawLine(0, 23, 95, 23, 0xFFFFFF);
+	result = initFrameScheduler(epollFd, frameRate, presentApp);
 	if (result < 0)
 		return -1;
 
-	result = drawText("A. Done", 20, 35, 0xFFFFFF);
-	if (result < 0)
+	//armed whenever a timed state is entered
+	const struct timespec disarmed = { 0, 0 };
+	timedStateTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &disarmed, &timedStateEventData, EPOLLIN);
+	if (timedStateTimerFd < 0)
 		return -1;
 
-	result = drawText("B. Open again", 20, 45, 0xFFFFFF);
-	if (result < 0)
+	tickTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &disarmed, &tickTimerEventData, EPOLLIN);
+	if (tickTimerFd < 0)
 		return -1;
 
+	if (LATENCY_REPORT_PERIOD_SECONDS > 0)
+	{
+		const struct timespec reportPeriod = { LATENCY_REPORT_PERIOD_SECONDS, 0 };
+		latencyTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &reportPeriod, &latencyEventData, EPOLLIN);
+		if (latencyTimerFd < 0)
+			return -1;
+	}
+
 	return 0;
 }
 
-static int drawWait()
+void cleanupApp()
 {
-	int result = fillScreen(0x404040);
-	if (result < 0)
-		return -1;
+	cleanupLockActuator();
+	for (int port = 0; port < SENSOR_PORT_COUNT; port++)
+		closeGpioPort(&sensorPorts[port]);
+	CloseFdAndPrintError(latencyTimerFd, "Latency timer");
+	CloseFdAndPrintError(timedStateTimerFd, "Timed state timer");
+	CloseFdAndPrintError(tickTimerFd, "App tick timer");
+	if (sensorTimerFd >= 0)
+		CloseFdAndPrintError(sensorTimerFd, "Sensor timer");
+	sensorTimerFd = -1;
+	cleanupFrameScheduler();
+	cleanupScenes();
+	cleanupDisplay();
+	cleanupKeyboard();
+}
 
-	result = drawText("Please wait...", 15, 28, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+static const char* unlockMessage = NULL; /*!< Telemetry sent once the running unlock opened the lock. */
+static int unlockingCompartment = 0; /*!< Compartment of the running unlock. */
+static int unlockAttempts = 0; /*!< Open phases the running unlock went through. */
+static bool isOpeningDeferred = false; /*!< Set if an unlock came while the servo was still returning, it opens once the servo is back. */
 
-	return 0;
+static void startOpening();
+
+static void lockReturned(int result)
+{
+	if (result != LOCK_ACTUATION_DONE)
+		Log_Debug("ERROR: Lock servo failed to return.\n");
+
+	if (isOpeningDeferred)
+	{
+		isOpeningDeferred = false;
+		startOpening();
+	}
 }
 
-static int drawInvalidCredentials()
+/**
+* Move the servo back to closed, the door locks once it is closed.
+*/
+static void returnLock(int durationMs, LockActuatedFunction returned)
 {
-	int result = fillScreen(0x404040);
-	if (result < 0)
-		return -1;
+	if (actuateLock(unlockingCompartment, LOCK_CLOSED_PULSE_US, durationMs, returned) < 0)
+		Log_Debug("ERROR: Could not return lock servo.\n");
+}
 
-	result = drawText("Invalid code", 15, 28, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+/**
+* Lock never opened, offer opening it again.
+*/
+static void failUnlock()
+{
+	//door opened late, the OPEN transition already applied the session
+	if (compartments[unlockingCompartment].lockState == LOCK_OPEN)
+	{
+		returnLock(LOCK_CLOSE_MS, lockReturned);
+		return;
+	}
 
-	return 0;
+	Log_Debug("ERROR: Lock did not open after %d attempts.\n", unlockAttempts);
+	SendTelemetry("LockFailed", "Lock did not open.");
+	returnLock(LOCK_CLOSE_MS, lockReturned);
+	dispatchAppEvent(EVENT_UNLOCK_FAILED, 0);
 }
 
-static int drawDrawerLocked()
+static void retryOpening(int result)
 {
-	int result = fillScreen(0x404040);
-	if (result < 0)
-		return -1;
+	if (result != LOCK_ACTUATION_DONE)
+		failUnlock();
+	else
+		startOpening();
+}
 
-	result = drawText("Too many", 15, 20, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+/**
+* Store or remove the code of the session once its compartment opened.
+*/
+static void applyPendingChange()
+{
+	if (!pendingChange.isPending)
+		return;
 
-	result = drawText("failed attempts", 15, 30, 0xFFFFFF);
-	if (result < 0)
-		return -1;
+	pendingChange.isPending = false;
+	struct compartment* compartment = &compartments[pendingChange.compartment];
+	if (pendingChange.operationType == POST)
+	{
+		//item goes in either way, an occupied compartment without a code is safer than an empty looking one
+		if (addCode(&codeStore, pendingChange.code, pendingChange.compartment) < 0)
+			Log_Debug("ERROR: Could not store code of compartment %d.\n", pendingChange.compartment);
+		compartment->isEmpty = false;
+	}
+	else
+	{
+		removeCode(&codeStore, pendingChange.code);
+		compartment->isEmpty = true;
+	}
+}
 
-	return 0;
+static void lockOpened(int result)
+{
+	if (result == LOCK_ACTUATION_DONE)
+	{
+		SendTelemetry("LockOpened", unlockMessage);
+		returnLock(LOCK_CLOSE_MS, lockReturned);
+	}
+	else if (result == LOCK_ACTUATION_TIMED_OUT && unlockAttempts < LOCK_OPEN_ATTEMPTS)
+	{
+		//latch may be jammed, back off and approach it again
+		Log_Debug("Lock did not open, retrying.\n");
+		returnLock(LOCK_RETRY_BACKOFF_MS, retryOpening);
+	}
+	else
+		failUnlock();
 }
 
-static int draw(bool isNewState, const struct appStateContainer*appState)
+/**
+* Drive the servo open until the door sensor reports the latch open.
+*/
+static void startOpening()
+{
+	//reopening right after the door closed finds the servo still returning, lockReturned() opens it then
+	if (isLockActuating())
+	{
+		isOpeningDeferred = true;
+		return;
+	}
+
+	unlockAttempts++;
+	struct gpioPort* sensorPort = &sensorPorts[unlockingCompartment / GPIO_PORT_MAX_PINS];
+	uint8_t sensorMask = 1 << (unlockingCompartment % GPIO_PORT_MAX_PINS);
+	if (actuateLockUntil(unlockingCompartment, LOCK_OPEN_PULSE_US, LOCK_OPEN_TIMEOUT_MS, sensorPort, sensorMask, sensorMask, lockOpened) < 0)
+	{
+		Log_Debug("ERROR: Could not open lock: %s (%d).\n", strerror(errno), errno);
+		failUnlock();
+	}
+}
+
+/**
+* Open the lock and move the servo back once the sensor confirms, the loop goes on meanwhile.
+*
+* Every open phase stops as soon as the latch reports open, phases that time out are retried up to
+* LOCK_OPEN_ATTEMPTS times. If the lock never opens LockFailed telemetry is sent and the lock
+* failed screen offers opening it again.
+*
+* @param compartment Compartment to be opened.
+* @param message Telemetry sent once the lock is open.
+*/
+static void unlock(int compartment, const char* message)
+{
+	static char numberedMessage[64];
+	if (COMPARTMENT_COUNT > 1)
+	{
+		snprintf(numberedMessage, sizeof(numberedMessage), "%s (door %d)", message, compartment + 1);
+		message = numberedMessage;
+	}
+
+	unlockingCompartment = compartment;
+	unlockMessage = message;
+	unlockAttempts = 0;
+	startOpening();
+}
+
+/**
+* Get event of a key.
+*
+* @return Event or -1 if the key means nothing to the app.
+*/
+static int keyToEvent(char key)
+{
+	switch (key)
+	{
+	case 'A':
+		return EVENT_KEY_A;
+	case 'B':
+		return EVENT_KEY_B;
+	case '#':
+		return EVENT_KEY_CONFIRM;
+	case '*':
+		return EVENT_KEY_BACK;
+	case 'D':
+		return EVENT_KEY_DELETE;
+	case '0':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+		return EVENT_KEY_DIGIT;
+	}
+	return -1;
+}
+
+static int countEmptyCompartments()
+{
+	int count = 0;
+	for (int i = 0; i < COMPARTMENT_COUNT; i++)
+	{
+		if (compartments[i].isEmpty)
+			count++;
+	}
+	return count;
+}
+
+/**
+* Offer storing while a compartment is empty and picking up while one is occupied, A takes the first offer.
+*/
+static void buildSelectScene(struct scene* scene)
+{
+	static char title[24];//scene keeps the text until it is presented
+	int empty = countEmptyCompartments();
+	bool canStore = empty > 0;
+	bool canPick = empty < COMPARTMENT_COUNT;
+
+	initScene(scene, 0xba9b02);
+	if (COMPARTMENT_COUNT == 1)
+		addSceneText(scene, canStore ? "Drawer is empty" : "Drawer is occupied", 5, 5, 0xFFFFFF, 0xba9b02);
+	else
+	{
+		snprintf(title, sizeof(title), "%d of %d free", empty, COMPARTMENT_COUNT);
+		addSceneText(scene, title, 5, 5, 0xFFFFFF, 0xba9b02);
+	}
+	addSceneLine(scene, 0, 15, 95, 15, 0xFFFFFF);
+	addSceneText(scene, canStore ? "A. store" : "A. pick up", 25, 30, 0xFFFFFF, 0xba9b02);
+	if (canStore && canPick)
+		addSceneText(scene, "B. pick up", 25, 40, 0xFFFFFF, 0xba9b02);
+}
+
+static void buildCodeScene(struct scene* scene, const char* code)
+{
+	initScene(scene, 0xba9b02);
+	addSceneText(scene, "Type your", 5, 5, 0xFFFFFF, 0xba9b02);
+	addSceneText(scene, "6-digits code", 5, 15, 0xFFFFFF, 0xba9b02);
+	addSceneLine(scene, 0, 23, 95, 23, 0xFFFFFF);
+	addSceneText(scene, code, 15, 35, 0xFFFFFF, 0xba9b02);
+	addSceneLine(scene, 10, 45, 85, 45, 0x36342e);
+}
+
+static void buildOpenScene(struct scene* scene)
+{
+	initScene(scene, 0xba9b02);
+	addSceneText(scene, "Locker is now", 5, 5, 0xFFFFFF, 0xba9b02);
+	addSceneText(scene, "open", 5, 15, 0xFFFFFF, 0xba9b02);
+	addSceneLine(scene, 0, 23, 95, 23, 0xFFFFFF);
+}
+
+static void buildClosedScene(struct scene* scene)
+{
+	initScene(scene, 0xba9b02);
+	addSceneText(scene, "Locker is now", 5, 5, 0xFFFFFF, 0xba9b02);
+	addSceneText(scene, "closed", 5, 15, 0xFFFFFF, 0xba9b02);
+	addSceneLine(scene, 0, 23, 95, 23, 0xFFFFFF);
+	addSceneText(scene, "A. Done", 20, 35, 0xFFFFFF, 0xba9b02);
+	addSceneText(scene, "B. Open again", 20, 45, 0xFFFFFF, 0xba9b02);
+}
+
+static void buildLockFailedScene(struct scene* scene)
+{
+	initScene(scene, 0x404040);
+	addSceneText(scene, "Could not open", 5, 5, 0xFFFFFF, 0x404040);
+	addSceneText(scene, "the lock", 5, 15, 0xFFFFFF, 0x404040);
+	addSceneLine(scene, 0, 23, 95, 23, 0xFFFFFF);
+	addSceneText(scene, "A. Done", 20, 35, 0xFFFFFF, 0x404040);
+	addSceneText(scene, "B. Try again", 20, 45, 0xFFFFFF, 0x404040);
+}
+
+static void buildWaitScene(struct scene* scene)
+{
+	initScene(scene, 0x404040);
+	addSceneText(scene, "Please wait...", 15, 28, 0xFFFFFF, 0x404040);
+}
+
+static void buildInvalidCredentialsScene(struct scene* scene)
+{
+	initScene(scene, 0x404040);
+	addSceneText(scene, "Invalid code", 15, 28, 0xFFFFFF, 0x404040);
+}
+
+static void buildDrawerLockedScene(struct scene* scene)
+{
+	initScene(scene, 0x404040);
+	addSceneText(scene, "Too many", 15, 20, 0xFFFFFF, 0x404040);
+	addSceneText(scene, "failed attempts", 15, 30, 0xFFFFFF, 0x404040);
+}
+
+/**
+* Build scene of the screen shown in given state.
+*
+* @param scene Scene to be built.
+* @param appState State to build the screen for.
+* @param code Code typed so far.
+* @return false if state has no screen of its own.
+*/
+static bool buildScene(struct scene* scene, const struct appStateContainer* appState, const char* code)
 {
-	return 0;
 	switch (appState->appState)
 	{
 	case SELECT:
-		return drawSelect(appState->isEmpty);
+		buildSelectScene(scene);
+		return true;
 	case CODE:
-		return drawCode(isNewState);
-		break;
+		buildCodeScene(scene, code);
+		return true;
 	case OPEN:
-		return drawOpen();
-		break;
+		buildOpenScene(scene);
+		return true;
 	case CLOSED:
-		return drawClosed();
-		break;
+		buildClosedScene(scene);
+		return true;
 	case WAIT:
-		return drawWait();
-		break;
+		buildWaitScene(scene);
+		return true;
 	case INVALID_CREDENTIALS:
-		return drawInvalidCredentials();
-		break;
+		buildInvalidCredentialsScene(scene);
+		return true;
 	case DRAWER_LOCKED:
-		return drawDrawerLocked();
-		break;
+		buildDrawerLockedScene(scene);
+		return true;
+	case LOCK_FAILED:
+		buildLockFailedScene(scene);
+		return true;
+	default:
+		return false;
 	}
-
-	return 0;
 }
 
-static bool isValidCodeValue()
+static int draw(const struct appStateContainer*appState)
 {
-	if (strlen(secretCode) == 6)
-		return true;
-	return false;
+	struct scene scene;
+
+	//only nodes that differ from the screen already shown get drawn
+	if (buildScene(&scene, appState, secretCode) && presentScene(&scene) < 0)
+		return -1;
+
+	//everything above was drawn into framebuffer so push changed regions to the display
+	return flushDisplay();
 }
 
-static bool nextScreen(char keyPressed, struct appStateContainer* appState)
+/**
+* Get states that usually follow given state, as done by nextScreen().
+*
+* @param state Current state.
+* @param successors Array of at least 2 states to be filled.
+* @return Number of successors.
+*/
+static int getLikelySuccessors(enum appStateEnum state, enum appStateEnum* successors)
 {
-	switch (appState->appState)
+	switch (state)
 	{
 	case SELECT:
-		if (keyPressed == 'A')
-		{
-			appState->appState = CODE;
-			appState->operationType = PICK;
-			return true;
-		}
+		successors[0] = CODE;
+		return 1;
 	case CODE:
-		if (isValidCodeValue() && keyPressed == '#')
-		{
-			if (!(appState->isEmpty) && !isValidCode())
-			{
-				appState->wrongAttempts++;
-				appState->appState = INVALID_CREDENTIALS;
-				return true;
-			}
-			appState->appState = WAIT;
-			return true;
-		}
-		break;
-
+		successors[0] = WAIT;
+		successors[1] = INVALID_CREDENTIALS;
+		return 2;
 	case WAIT:
-		if (keyPressed = '!' && appState->lockState == LOCK_OPEN)
-		{
-			clearSecretCode();
-			appState->appState = OPEN;
-			return true;
-		}
-		break;
+		successors[0] = OPEN;
+		successors[1] = LOCK_FAILED;
+		return 2;
 	case OPEN:
-		if (keyPressed = '!' && appState->lockState == LOCK_CLOSED)
-		{
-			appState->appState = CLOSED;
-			SendTelemetry("LockClosed", "Lock is now closed.");
-			return true;
-		}
-		break;
+		successors[0] = CLOSED;
+		return 1;
 	case CLOSED:
-		if (keyPressed == 'A')
-		{
-			appState->appState = SELECT;
-			return true;
-		}
-		else if (keyPressed == 'B')
-		{
-			appState->appState = WAIT;
-			appState->isReopen = true;
-			return true;
-		}
-		break;
+		successors[0] = SELECT;
+		successors[1] = WAIT;
+		return 2;
 	case INVALID_CREDENTIALS:
-		clearSecretCode();
-		if (appState->wrongAttempts >= 3)
-		{
-			appState->appState = DRAWER_LOCKED;
-			return true;
-		}
-		appState->appState = CODE;
-		return true;
-		break;
+		successors[0] = CODE;
+		successors[1] = DRAWER_LOCKED;
+		return 2;
 	case DRAWER_LOCKED:
-		appState->appState = SELECT;
-		appState->wrongAttempts = 0;
-		return true;
-		break;
+		successors[0] = SELECT;
+		return 1;
+	case LOCK_FAILED:
+		successors[0] = SELECT;
+		successors[1] = WAIT;
+		return 2;
+	default:
+		return 0;
 	}
-	return false;
 }
 
-static bool previousScreen(struct appStateContainer* appState)
+static int prerenderedSuccessors = 0; /*!< Successors of the current state entry already prerendered, reset on every state change. */
+
+/**
+* Check if some screen likely to follow the current one wasn't prerendered for the current state entry yet.
+*/
+static bool hasScreensToPrerender(const struct appStateContainer* appState)
+{
+	enum appStateEnum successors[2];
+	return prerenderedSuccessors < getLikelySuccessors(appState->appState, successors);
+}
+
+/**
+* Record one of the screens likely to follow the current one, so the transition costs only the flush.
+*
+* Called on idle runs of runApp(), every call takes the next successor until each of them was recorded
+* once for the current state entry.
+*/
+static void prerenderNextScreen(const struct appStateContainer* appState)
 {
-	switch (appState->appState)
+	enum appStateEnum successors[2];
+	int count = getLikelySuccessors(appState->appState, successors);
+	if (prerenderedSuccessors >= count)
+		return;
+
+	struct appStateContainer predicted = *appState;
+	predicted.appState = successors[prerenderedSuccessors++];
+
+	//code is always cleared before the code screen is entered again
+	struct scene scene;
+	if (buildScene(&scene, &predicted, ""))
+		prerenderScene(&scene);//failure only means the screen gets drawn when it comes
+}
+
+/**
+* Draw current state of the app, called by the frame scheduler.
+*/
+static int presentApp()
+{
+	int result = draw(&currentAppState);
+	if (result < 0 || !hasUnpresentedKey)
+		return result;
+
+	//frame with the key is on its way, it is on the display once the render thread finishes it
+	if (isRenderingKey)
+		recordLatencySince(&keyToPixelLatency, &renderingKeyAt);//previous frame finished, its event wasn't handled yet
+	if (isRenderBusy())
 	{
-	case CODE:
-		appState->appState = SELECT;
-		clearSecretCode();
-		return true;
+		renderingKeyAt = unpresentedKeyAt;
+		isRenderingKey = true;
+	}
+	else
+	{
+		recordLatencySince(&keyToPixelLatency, &unpresentedKeyAt);
+		isRenderingKey = false;
 	}
+	hasUnpresentedKey = false;
+	return result;
+}
+
+static bool isValidCodeValue()
+{
+	if (strlen(secretCode) == CODE_LENGTH)
+		return true;
 	return false;
 }
 
+/**
+* Set how long wrong codes keep the keypad out, durations already running are not changed.
+*
+* @param invalidMs Time invalid code screen is shown after every wrong code, -1 keeps the current one.
+* @param firstLockoutSeconds Duration of the first lockout after MAX_WRONG_ATTEMPTS wrong codes, every further one doubles, -1 keeps the current one.
+* @param maxSeconds Longest lockout, -1 keeps the current one.
+* @return 0 or -1 if durations are out of range.
+*/
+int setLockoutDurations(int invalidMs, int firstLockoutSeconds, int maxSeconds)
+{
+	if (invalidMs < 0)
+		invalidMs = invalidCodeMs;
+	if (firstLockoutSeconds < 0)
+		firstLockoutSeconds = lockoutSeconds;
+	if (maxSeconds < 0)
+		maxSeconds = maxLockoutSeconds;
+	if (maxSeconds < firstLockoutSeconds)
+		return -1;
+
+	invalidCodeMs = invalidMs;
+	lockoutSeconds = firstLockoutSeconds;
+	maxLockoutSeconds = maxSeconds;
+	return 0;
+}
+
+/**
+* Get duration of the next lockout, doubled for every lockout since the last valid code.
+*/
+static int getLockoutSeconds(const struct appStateContainer* appState)
+{
+	int seconds = lockoutSeconds;
+	for (int i = 0; i < appState->lockouts && seconds < maxLockoutSeconds; i++)
+		seconds *= 2;
+
+	return seconds < maxLockoutSeconds ? seconds : maxLockoutSeconds;
+}
+
+static int armTimedState(int ms)
+{
+	struct timespec delay = { ms / 1000, (ms % 1000) * 1000000L };
+	//zero would disarm the timer and the state would never end
+	if (ms == 0)
+		delay.tv_nsec = 1;
+	return SetTimerFdToSingleExpiry(timedStateTimerFd, &delay);
+}
+
+static int disarmTimedState()
+{
+	const struct timespec disarmed = { 0, 0 };
+	return SetTimerFdToSingleExpiry(timedStateTimerFd, &disarmed);
+}
+
 bool updateCodeValue(char c)
 {
 	int len = strlen(secretCode);
-	if (len == 6)
+	if (len == CODE_LENGTH)
 		return false;
 	secretCode[len] = c;
 	return true;
@@ -526,159 +978,451 @@ bool removeDigitFromCodeValue()
 	return true;
 }
 
+static bool isCodeIncomplete(void* context, int key)
+{
+	return !isValidCodeValue();
+}
 
+static bool hasCodeDigits(void* context, int key)
+{
+	return secretCode[0] != '\0';
+}
 
-static bool doAction(char key, struct appStateContainer* appState)
+static bool isCodeComplete(void* context, int key)
 {
-	if (key == '!' && appState->appState != OPEN && appState->appState != WAIT && !alert)
-	{
-		Log_Debug("Alert!\n");
-		SendTelemetry("ButtonPress", "Alert! Lock open.");
-		alert = true;
-	}
+	return isValidCodeValue();
+}
+
+/**
+* Check if a complete code can't be used, picking needs a stored code and storing a code not in use yet.
+*
+* Taken codes count as wrong too, otherwise storing would let anyone probe for codes of occupied compartments.
+*/
+static bool isWrongCode(void* context, int key)
+{
+	const struct appStateContainer* appState = context;
+	if (!isValidCodeValue())
+		return false;
+
+	bool isStored = findCode(&codeStore, secretCode) >= 0;
+	return appState->operationType == PICK ? !isStored : isStored;
+}
 
-	enum actionEnum nextAction;
-	nextAction = keyToAction(key);
+static bool canStore(void* context, int key)
+{
+	return countEmptyCompartments() > 0;
+}
+
+static bool canPick(void* context, int key)
+{
+	return countEmptyCompartments() < COMPARTMENT_COUNT;
+}
+
+/**
+* Check if a sensor event comes from the compartment the session opens.
+*/
+static bool isSessionCompartment(void* context, int compartment)
+{
+	const struct appStateContainer* appState = context;
+	return compartment == appState->compartment;
+}
+
+static bool isLockoutDue(void* context, int key)
+{
+	const struct appStateContainer* appState = context;
+	return appState->wrongAttempts >= MAX_WRONG_ATTEMPTS;
+}
 
-	switch (nextAction)
+static bool isAlertPending(void* context, int argument)
+{
+	return !alert;
+}
+
+/**
+* Compartment of the session opened, even if the unlock gave up on it before.
+*/
+static int openCompartment(void* context, int compartment)
+{
+	applyPendingChange();
+	return 0;
+}
+
+static int addCodeDigit(void* context, int key)
+{
+	updateCodeValue((char)key);
+	return 0;
+}
+
+static int removeCodeDigit(void* context, int key)
+{
+	removeDigitFromCodeValue();
+	return 0;
+}
+
+static int clearCode(void* context)
+{
+	clearSecretCode();
+	return 0;
+}
+
+static int discardCode(void* context, int argument)
+{
+	return clearCode(context);
+}
+
+static int startStore(void* context, int key)
+{
+	struct appStateContainer* appState = context;
+	appState->operationType = POST;
+	return 0;
+}
+
+static int startPick(void* context, int key)
+{
+	struct appStateContainer* appState = context;
+	appState->operationType = PICK;
+	return 0;
+}
+
+/**
+* Choose the compartment of a confirmed code, the one holding it or the first empty one, and keep
+* the change for when its lock opens.
+*/
+static int chooseCompartment(void* context, int key)
+{
+	struct appStateContainer* appState = context;
+	appState->compartment = -1;
+	if (appState->operationType == PICK)
+		appState->compartment = findCode(&codeStore, secretCode);
+	else
 	{
-	case NEXT_SCREEN:
-		return nextScreen(key, appState);
-		break;
-	case PREVIOUS_SCREEN:
-		return previousScreen(appState);
-		break;
-		break;
-	case ADD_TO_VALUE:
-		if (appState->appState == CODE)
-		{
-			return updateCodeValue(key);
-		}
-		break;
-	case REMOVE_FROM_VALUE:
-		if (appState->appState == CODE)
+		for (int i = 0; i < COMPARTMENT_COUNT && appState->compartment < 0; i++)
 		{
-			return removeDigitFromCodeValue();
+			if (compartments[i].isEmpty)
+				appState->compartment = i;
 		}
-		break;
-	default:
-		break;
 	}
+	if (appState->compartment < 0)
+		return -1;
+
+	pendingChange.isPending = true;
+	pendingChange.operationType = appState->operationType;
+	pendingChange.compartment = appState->compartment;
+	strcpy(pendingChange.code, secretCode);
 	return 0;
 }
 
-static void manageState(bool isNewState, struct appStateContainer* appState)
+static int countWrongAttempt(void* context, int key)
 {
-	const struct timespec sleepTime = { 3, 0 };
-	const struct timespec sleepTime1 = { 60, 0 };
-	switch (appState->appState)
+	struct appStateContainer* appState = context;
+	appState->wrongAttempts++;
+	return 0;
+}
+
+static int forgiveWrongAttempts(void* context, int argument)
+{
+	struct appStateContainer* appState = context;
+	appState->wrongAttempts = 0;
+	return 0;
+}
+
+static int reportLockClosed(void* context, int argument)
+{
+	SendTelemetry("LockClosed", "Lock is now closed.");
+	return 0;
+}
+
+/**
+* Door sensor changed while nobody was let in.
+*/
+static int raiseAlert(void* context, int argument)
+{
+	Log_Debug("Alert!\n");
+	SendTelemetry("ButtonPress", "Alert! Lock open.");
+	alert = true;
+	return 0;
+}
+
+/**
+* Open the lock for whoever got to the wait screen, the lock runs on its own while the screen is shown.
+*
+* Compartment changes once the lock opened, see applyPendingChange().
+*/
+static int enterWait(void* context)
+{
+	struct appStateContainer* appState = context;
+	if (!pendingChange.isPending)
+		unlock(appState->compartment, "Lock reopened.");
+	else if (pendingChange.operationType == POST)
+		unlock(appState->compartment, "Lock opened to store item.");
+	else
 	{
-	case WAIT:
-		if (isNewState)
-		{
-			if (appState->isReopen)
-			{
-				unlock();
-				SendTelemetry("LockOpened", "Lock reopened.");
-				appState->isReopen = false;
-			}
-			else
-			{
-				if (appState->isEmpty)
-				{
-					appState->isEmpty = false;
-					saveSecretCode();
-					//clearSecretCode();
-					unlock();
-					SendTelemetry("LockOpened", "Lock opened to store item.");
-				}
-				else if (isValidCodeValue())
-				{
-					if (isValidCode())
-					{
-						appState->isEmpty = true;
-						appState->wrongAttempts = 0;
-						unlock();
-						SendTelemetry("LockOpened", "Lock reopened to pick up item");
-						//clearSecretCode();
-					}
-				}
-			}
-		}
-		break;
-	case INVALID_CREDENTIALS:
-		nanosleep(&sleepTime, NULL);
-		break;
-	case DRAWER_LOCKED:
-		nanosleep(&sleepTime1, NULL);
-		break;
+		//code was right even if the lock jams
+		appState->wrongAttempts = 0;
+		appState->lockouts = 0;
+		unlock(appState->compartment, "Lock reopened to pick up item");
 	}
+	return 0;
+}
+
+/**
+* Show invalid code screen for a while, the loop goes on meanwhile.
+*/
+static int enterInvalidCredentials(void* context)
+{
+	return armTimedState(invalidCodeMs);
+}
+
+static int exitInvalidCredentials(void* context)
+{
+	clearSecretCode();
+	return disarmTimedState();
+}
+
+/**
+* Keep the keypad out for a lockout that doubles with every lockout since the last valid code.
+*/
+static int enterDrawerLocked(void* context)
+{
+	struct appStateContainer* appState = context;
+	int seconds = getLockoutSeconds(appState);
+	Log_Debug("Drawer locked for %d s\n", seconds);
+	//capped lockouts stay capped, counting on would wrap back to the first duration
+	if (seconds < maxLockoutSeconds)
+		appState->lockouts++;
+	return armTimedState(seconds * 1000);
+}
+
+static int exitDrawerLocked(void* context)
+{
+	return disarmTimedState();
+}
+
+#define TRANSITIONS(transitions) { transitions, sizeof(transitions) / sizeof(transitions[0]) }
+
+static const struct stateTransition alertTransitions[] = { { isAlertPending, raiseAlert, STATE_STAY } };
+static const struct stateTransition selectATransitions[] = {
+	{ canStore, startStore, CODE },
+	{ canPick, startPick, CODE }
+};
+static const struct stateTransition selectBTransitions[] = { { canPick, startPick, CODE } };
+static const struct stateTransition addDigitTransitions[] = { { isCodeIncomplete, addCodeDigit, STATE_STAY } };
+static const struct stateTransition removeDigitTransitions[] = { { hasCodeDigits, removeCodeDigit, STATE_STAY } };
+static const struct stateTransition confirmCodeTransitions[] = {
+	{ isWrongCode, countWrongAttempt, INVALID_CREDENTIALS },
+	{ isCodeComplete, chooseCompartment, WAIT }
+};
+static const struct stateTransition leaveCodeTransitions[] = { { NULL, discardCode, SELECT } };
+static const struct stateTransition openedTransitions[] = {
+	{ isSessionCompartment, openCompartment, OPEN },
+	{ isAlertPending, raiseAlert, STATE_STAY }
+};
+static const struct stateTransition unlockFailedTransitions[] = { { NULL, NULL, LOCK_FAILED } };
+static const struct stateTransition closedTransitions[] = {
+	{ isSessionCompartment, reportLockClosed, CLOSED },
+	{ isAlertPending, raiseAlert, STATE_STAY }
+};
+static const struct stateTransition doneTransitions[] = { { NULL, NULL, SELECT } };
+static const struct stateTransition reopenTransitions[] = { { NULL, NULL, WAIT } };
+static const struct stateTransition invalidOverTransitions[] = {
+	{ isLockoutDue, NULL, DRAWER_LOCKED },
+	{ NULL, NULL, CODE }
+};
+static const struct stateTransition lockoutOverTransitions[] = { { NULL, forgiveWrongAttempts, SELECT } };
+
+/**
+* What every event does in every state, events missing in a state are ignored there.
+*/
+static const struct stateRule appRules[APP_STATE_COUNT][EVENT_COUNT] = {
+	[SELECT] = {
+		[EVENT_KEY_A] = TRANSITIONS(selectATransitions),
+		[EVENT_KEY_B] = TRANSITIONS(selectBTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+	[CODE] = {
+		[EVENT_KEY_CONFIRM] = TRANSITIONS(confirmCodeTransitions),
+		[EVENT_KEY_BACK] = TRANSITIONS(leaveCodeTransitions),
+		[EVENT_KEY_DIGIT] = TRANSITIONS(addDigitTransitions),
+		[EVENT_KEY_DELETE] = TRANSITIONS(removeDigitTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+	[WAIT] = {
+		[EVENT_LOCK_OPENED] = TRANSITIONS(openedTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+		[EVENT_UNLOCK_FAILED] = TRANSITIONS(unlockFailedTransitions),
+	},
+	[OPEN] = {
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(closedTransitions),
+	},
+	[CLOSED] = {
+		[EVENT_KEY_A] = TRANSITIONS(doneTransitions),
+		[EVENT_KEY_B] = TRANSITIONS(reopenTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+	[INVALID_CREDENTIALS] = {
+		[EVENT_TIMEOUT] = TRANSITIONS(invalidOverTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+	[DRAWER_LOCKED] = {
+		[EVENT_TIMEOUT] = TRANSITIONS(lockoutOverTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(alertTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+	[LOCK_FAILED] = {
+		[EVENT_KEY_A] = TRANSITIONS(doneTransitions),
+		[EVENT_KEY_B] = TRANSITIONS(reopenTransitions),
+		[EVENT_LOCK_OPENED] = TRANSITIONS(openedTransitions),
+		[EVENT_LOCK_CLOSED] = TRANSITIONS(alertTransitions),
+	},
+};
+
+static int enterSelect(void* context)
+{
+	struct appStateContainer* appState = context;
+	appState->compartment = -1;
+	pendingChange.isPending = false;//store or pick up whose lock never opened is given up
+	return 0;
+}
+
+static const struct stateHooks appHooks[APP_STATE_COUNT] = {
+	[SELECT] = { enterSelect, NULL },
+	[CODE] = { clearCode, NULL },
+	[OPEN] = { clearCode, NULL },
+	[WAIT] = { enterWait, NULL },
+	[INVALID_CREDENTIALS] = { enterInvalidCredentials, exitInvalidCredentials },
+	[DRAWER_LOCKED] = { enterDrawerLocked, exitDrawerLocked },
+};
+
+static const struct stateMachineDefinition appMachineDefinition = { APP_STATE_COUNT, EVENT_COUNT, &appRules[0][0], appHooks };
+
+/**
+* Log recent transitions of the app, oldest first.
+*/
+static void logStateTrace()
+{
+	struct stateTraceEntry entries[STATE_TRACE_SIZE];
+	int count = getStateTrace(&appMachine, entries, STATE_TRACE_SIZE);
+	for (int i = 0; i < count; i++)
+	{
+		Log_Debug("%ld.%03ld state %d event %d -> state %d\n", (long)entries[i].at.tv_sec, entries[i].at.tv_nsec / 1000000L,
+			entries[i].from, entries[i].event, entries[i].to);
+	}
+}
+
+/**
+* Pass an event to the app state machine, any transition gets the screen redrawn.
+*
+* @param event Event that happened.
+* @param argument Key of key events, compartment of sensor events, 0 otherwise.
+* @return 1 if the app changed, 0 if the event was ignored or -1 if handling it failed.
+*/
+static int dispatchAppEvent(enum appEventEnum event, int argument)
+{
+	int result = dispatchStateEvent(&appMachine, event, argument);
+	currentAppState.appState = appMachine.state;
+	if (result > 0)
+		currentAppState.redrawRequired = true;
+	else if (result < 0)
+	{
+		Log_Debug("ERROR: App failed to handle event %d.\n", event);
+		logStateTrace();
+		hasEventFailed = true;
+	}
+	return result;
 }
 
 void appStateStructInit(struct appStateContainer* appState)
 {
 	appState->appState = SELECT;
 	appState->operationType = PICK;
-	appState->isKeyPressed = false;
 	appState->redrawRequired = true;
-	appState->isReopen = false;
 	appState->isValidationSuccessful = true;
-	appState->lockState = GPIO_Value_Low;
-	appState->isEmpty = true;
+	appState->compartment = -1;
 	appState->wrongAttempts = 0;
+	appState->lockouts = 0;
 	appState->alert = false;
 }
 
+/**
+* Take pressed keys and present whatever the last event changed, call after every event of the loop.
+*
+* Nothing is polled here, keys, door sensors and timers wake the loop themselves, so an idle app
+* sleeps until something happens.
+*
+* @return 0 or -1 if something went wrong.
+*/
 int runApp()
 {
-	static struct appStateContainer appState;
+	struct appStateContainer* appState = &currentAppState;
 	static bool fstRun = true;
 
-	//manage events
-	bool changed = lockStateChanged(&(appState.lockState));
-
 	if (fstRun)
 	{
-		appStateStructInit(&appState);
+		appStateStructInit(appState);
+		initStateMachine(&appMachine, &appMachineDefinition, appState->appState, appState);
 		fstRun = false;
 	}
-	if (appState.appState == INVALID_CREDENTIALS || appState.appState == DRAWER_LOCKED)
-	{
-		appState.redrawRequired = doAction('!', &appState);
-	}
-	else if (changed)
-	{
-		appState.redrawRequired = doAction('!', &appState);
-	}
-
-	char key = 0;
-	int result = checkForKeyPress(&key);
-	if (result < 0)
+	//frame from a failed presentation is lost, stop like a failed draw would
+	if (hasFrameFailed() || hasEventFailed)
 		return -1;
-	else if (key != 0 && !appState.isKeyPressed)
+
+	//keys typed while the loop was busy wait in the ring, stop at a new state so its screen gets shown
+	enum appStateEnum stateBeforeKeys = appState->appState;
+	bool keyTaken = false;
+	struct keyEvent keyEvent;
+	int result = 0;
+	while (appState->appState == stateBeforeKeys && (result = takeKeyEvent(&keyEvent)) > 0)
 	{
-		appState.isKeyPressed = true;
+		keyTaken = true;
+		recordLatencySince(&keyToInputLatency, &keyEvent.pressedAt);
+		if (dispatchAppEvent(keyToEvent(keyEvent.key), keyEvent.key) <= 0)
+			continue;
 
-		appState.redrawRequired = doAction(key, &appState);
+		recordLatencySince(&keyToActionLatency, &keyEvent.pressedAt);
+		if (!hasUnpresentedKey)
+		{
+			unpresentedKeyAt = keyEvent.pressedAt;
+			hasUnpresentedKey = true;
+		}
 	}
-	else if (key == 0)
+	if (result < 0 || hasEventFailed)
+		return -1;
+
+	bool isNewState = stateChanged(appState->appState);
+	if (isNewState)
 	{
-		appState.isKeyPressed = false;
+		prerenderedSuccessors = 0;
+		if (armSensorTimer(appState->appState) < 0)
+			return -1;
 	}
 
-	bool isNewState = stateChanged(appState.appState);
+	bool isIdle = !isNewState && !keyTaken && !appState->redrawRequired;
 
-	//manage drawing
-	if (appState.redrawRequired)
+	//manage drawing, frame is presented from the event loop once this run is over
+	if (appState->redrawRequired)
 	{
-		int result = draw(isNewState, &appState);
+		int result = requestFrame();
 		if (result < 0)
 			return -1;
-		appState.redrawRequired = false;
+		appState->redrawRequired = false;
 	}
 
-	//manage state
-	manageState(isNewState, &appState);
+	//nothing happened since the last run, prepare screens that may come next
+	if (isIdle)
+		prerenderNextScreen(appState);
+
+	//keys behind a new screen and screens left to prerender get another run, otherwise nothing runs until the next event
+	if (appState->appState != stateBeforeKeys || hasScreensToPrerender(appState))
+	{
+		const struct timespec delay = { 0, APP_TICK_MS * 1000000L };
+		if (SetTimerFdToSingleExpiry(tickTimerFd, &delay) != 0)
+			return -1;
+	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #pragma once
 
-int initApp();
+int initApp(int epollFd);
 void cleanupApp();
-int runApp();
\ No newline at end of file
+int runApp();
+int setLockoutDurations(int invalidMs, int firstLockoutSeconds, int maxSeconds);
\ No newline at end of file
@@ -0,0 +1,274 @@
+/**
+* Host benchmark of the display pipeline.
+*
+* app.c is built together with the display driver against recording stand-ins of applibs and walked
+* through its screens. For every step the report shows what reached the SPI bus and how long it
+* would take. Settle waits are recorded instead of slept and transfers take no time on the host,
+* so the wait column is the upper bound of what the driver waits on real hardware.
+*
+* Usage: bench [--baseline file] [--write-baseline file]
+* With --baseline steps that need more SPI calls or bytes than the baseline are reported and
+* the benchmark exits with 1.
+*/
+#include "../app.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "keypad_backend.h"
+#include "recorder.h"
+
+#define STEP_NAME_LENGTH 32 /*!< Maximum length of a step name including terminator. */
+
+/**
+* Screen shown by a single step of the benchmark.
+*/
+struct benchStep {
+	const char *name; /**< Name in the report, without spaces. */
+	enum appStateEnum state; /**< State of the app to be drawn. */
+	bool isEmpty; /**< Whether the drawer is empty. */
+	const char *code; /**< Code typed so far. */
+};
+
+/**
+* Result of a step, also the format of a baseline line.
+*/
+struct benchResult {
+	char name[STEP_NAME_LENGTH]; /**< Name of the step. */
+	struct recording recording; /**< What reached the bus. */
+};
+
+static const struct benchStep steps[] = {
+	{ "select_empty", SELECT, true, "" },
+	{ "select_occupied", SELECT, false, "" },
+	{ "code", CODE, false, "" },
+	{ "code_digit_1", CODE, false, "1" },
+	{ "code_digit_2", CODE, false, "12" },
+	{ "code_delete", CODE, false, "1" },
+	{ "code_full", CODE, false, "123456" },
+	{ "invalid_credentials", INVALID_CREDENTIALS, false, "" },
+	{ "drawer_locked", DRAWER_LOCKED, false, "" },
+	{ "wait", WAIT, false, "" },
+	{ "open", OPEN, false, "" },
+	{ "closed", CLOSED, false, "" },
+	{ "select_again", SELECT, true, "" },
+	{ "wait_again", WAIT, true, "" },
+	{ "open_again", OPEN, true, "" },
+	{ "lock_failed", LOCK_FAILED, true, "" },
+};
+
+static const uint32_t busClocks[] = { 400000, 2000000, 6666666 }; /*!< Modelled SPI clocks, the last one is SSD1331 maximum. */
+
+#define STEP_COUNT (sizeof(steps) / sizeof(steps[0]))
+#define BUS_CLOCK_COUNT (sizeof(busClocks) / sizeof(busClocks[0]))
+
+/**
+* Get microseconds needed to shift given bytes out at given clock.
+*/
+static long getBusTimeUs(long bytes, uint32_t clock)
+{
+	return (long)(bytes * 8 * 1000000LL / clock);
+}
+
+static void printHeader()
+{
+	printf("%-20s %6s %6s %7s %7s %9s", "step", "calls", "xfers", "bytes", "toggles", "wait us");
+	for (size_t i = 0; i < BUS_CLOCK_COUNT; i++)
+		printf(" %8.1fMHz", busClocks[i] / 1000000.0);
+	printf("\n");
+}
+
+static void printResult(const struct benchResult *result)
+{
+	const struct recording *r = &result->recording;
+	printf("%-20s %6ld %6ld %7ld %7ld %9ld", result->name, r->calls, r->transfers, r->bytes, r->modeToggles, r->waitUs);
+	for (size_t i = 0; i < BUS_CLOCK_COUNT; i++)
+		printf(" %9ldus", getBusTimeUs(r->bytes, busClocks[i]) + r->waitUs);
+	printf("\n");
+}
+
+/**
+* Run every step and collect what reached the bus.
+*
+* @param results Array of STEP_COUNT + 1 results, the first one is initialization.
+* @return 0 or -1 if something went wrong.
+*/
+static int runSteps(struct benchResult *results)
+{
+	//nobody touches the keypad, keep its thread idle
+	setKeypadBackend(&mockKeypadBackend);
+
+	resetRecording();
+	int epollFd = CreateEpollFd();
+	if (epollFd < 0 || initApp(epollFd) < 0)
+		return -1;
+
+	//flush synchronously so every step is measured on its own
+	stopRenderThread();
+	if (flushDisplay() < 0)
+		return -1;
+
+	strcpy(results[0].name, "init");
+	results[0].recording = getRecording();
+
+	struct appStateContainer appState;
+	appStateStructInit(&appState);
+	for (size_t i = 0; i < STEP_COUNT; i++)
+	{
+		appState.appState = steps[i].state;
+		compartments[0].isEmpty = steps[i].isEmpty;
+		strcpy(secretCode, steps[i].code);
+
+		resetRecording();
+		if (draw(&appState) < 0)
+			return -1;
+
+		snprintf(results[i + 1].name, STEP_NAME_LENGTH, "%s", steps[i].name);
+		results[i + 1].recording = getRecording();
+	}
+
+	return 0;
+}
+
+/**
+* Get microseconds of CPU time drawing given state takes, SPI is recorded so this is rendering only.
+*/
+static long timeDraw(struct appStateContainer *appState)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	draw(appState);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/**
+* Compare code to wait transition with an empty scene cache and with successors prerendered while idle.
+*/
+static void runPrerenderComparison()
+{
+	struct appStateContainer appState;
+	appStateStructInit(&appState);
+	strcpy(secretCode, "123456");
+
+	long results[2];
+	for (int prerender = 0; prerender < 2; prerender++)
+	{
+		cleanupScenes();
+		appState.appState = CODE;
+		draw(&appState);
+
+		//two idle ticks record both successors of the code screen
+		if (prerender)
+		{
+			prerenderNextScreen(&appState);
+			prerenderNextScreen(&appState);
+		}
+
+		appState.appState = WAIT;
+		results[prerender] = timeDraw(&appState);
+	}
+
+	printf("\ncode -> wait render time: %ldus cold, %ldus prerendered\n", results[0], results[1]);
+}
+
+static int writeBaseline(const char *path, const struct benchResult *results, size_t count)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL)
+		return -1;
+
+	for (size_t i = 0; i < count; i++)
+		fprintf(file, "%s %ld %ld %ld\n", results[i].name, results[i].recording.calls, results[i].recording.bytes, results[i].recording.modeToggles);
+
+	return fclose(file);
+}
+
+/**
+* Compare results with the baseline and report every step that got worse.
+*
+* @return Number of regressions or -1 if baseline can't be read.
+*/
+static int compareWithBaseline(const char *path, const struct benchResult *results, size_t count)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	int regressions = 0;
+	struct benchResult baseline;
+	while (fscanf(file, "%31s %ld %ld %ld", baseline.name, &baseline.recording.calls, &baseline.recording.bytes, &baseline.recording.modeToggles) == 4)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (strcmp(results[i].name, baseline.name) != 0)
+				continue;
+
+			const struct recording *r = &results[i].recording;
+			bool worse = r->calls > baseline.recording.calls || r->bytes > baseline.recording.bytes;
+			if (worse || r->bytes != baseline.recording.bytes)
+			{
+				printf("%-20s calls %ld -> %ld, bytes %ld -> %ld%s\n", baseline.name, baseline.recording.calls, r->calls,
+					baseline.recording.bytes, r->bytes, worse ? "  REGRESSION" : "");
+			}
+			if (worse)
+				regressions++;
+		}
+	}
+
+	fclose(file);
+	return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *baselinePath = NULL;
+	const char *writePath = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc)
+			writePath = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [--baseline file] [--write-baseline file]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	static struct benchResult results[STEP_COUNT + 1];
+	if (runSteps(results) < 0)
+	{
+		fprintf(stderr, "benchmark failed\n");
+		return 1;
+	}
+
+	printHeader();
+	for (size_t i = 0; i < STEP_COUNT + 1; i++)
+		printResult(&results[i]);
+
+	runPrerenderComparison();
+	cleanupApp();
+
+	if (writePath != NULL && writeBaseline(writePath, results, STEP_COUNT + 1) != 0)
+	{
+		fprintf(stderr, "can't write %s\n", writePath);
+		return 1;
+	}
+
+	if (baselinePath != NULL)
+	{
+		printf("\nchanges against %s:\n", baselinePath);
+		int regressions = compareWithBaseline(baselinePath, results, STEP_COUNT + 1);
+		if (regressions < 0)
+		{
+			fprintf(stderr, "can't read %s\n", baselinePath);
+			return 1;
+		}
+		printf("%d regression(s)\n", regressions);
+		return regressions > 0 ? 1 : 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/**
+* Host check of the code store.
+*
+* Builds probe chains that wrap around the end of the table and removes codes from them, then runs
+* random adds and removes against a plain array of the same codes. Every code kept has to be found
+* with its compartment after every step, removed codes must not be found.
+*
+* Usage: code_store_check
+* Exits with 1 if any check failed.
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "code_store.h"
+
+#define FUZZ_STEPS 50000 /*!< Random adds and removes. */
+#define FUZZ_CODES 200 /*!< Distinct codes used by the fuzz, few enough to hit the same ones again. */
+
+static int failures = 0;
+
+static void check(bool passed, const char *what)
+{
+	printf("%-40s %s\n", what, passed ? "ok" : "FAILED");
+	if (!passed)
+		failures++;
+}
+
+/**
+* Write last CODE_LENGTH digits of a value as a code.
+*/
+static void formatCode(int value, char *code)
+{
+	for (int i = CODE_LENGTH - 1; i >= 0; i--, value /= 10)
+		code[i] = (char)('0' + value % 10);
+	code[CODE_LENGTH] = '\0';
+}
+
+/**
+* Get first slot of a code, the slot it takes in an empty store.
+*/
+static int getHomeSlot(int value)
+{
+	struct codeStore store;
+	char code[CODE_LENGTH + 1];
+	initCodeStore(&store);
+	formatCode(value, code);
+	addCode(&store, code, 0);
+	for (int i = 0; i < CODE_STORE_SLOTS; i++)
+	{
+		if (store.codes[i] == (uint32_t)value)
+			return i;
+	}
+	return -1;
+}
+
+/**
+* Find codes starting at given slot.
+*
+* @param slot Home slot the codes need.
+* @param values Filled with count codes.
+*/
+static void findCodesAt(int slot, int *values, int count)
+{
+	for (int value = 0, found = 0; found < count; value++)
+	{
+		if (getHomeSlot(value) == slot)
+			values[found++] = value;
+	}
+}
+
+/**
+* Chain of two codes starting in the last slot wraps to slot 0, a code of slot 0 goes after them.
+* Removing the first code has to shift both back across the end of the table.
+*/
+static void checkWrappingChain()
+{
+	int last[2];
+	int first;
+	findCodesAt(CODE_STORE_SLOTS - 1, last, 2);
+	findCodesAt(0, &first, 1);
+
+	struct codeStore store;
+	char codes[3][CODE_LENGTH + 1];
+	initCodeStore(&store);
+	formatCode(last[0], codes[0]);
+	formatCode(last[1], codes[1]);
+	formatCode(first, codes[2]);
+	for (int i = 0; i < 3; i++)
+		addCode(&store, codes[i], i + 1);
+
+	check(store.codes[CODE_STORE_SLOTS - 1] == (uint32_t)last[0] && store.codes[0] == (uint32_t)last[1] && store.codes[1] == (uint32_t)first,
+		"probe chain wraps around");
+
+	check(removeCode(&store, codes[0]) == 0, "code at the end is removed");
+	check(findCode(&store, codes[0]) < 0, "removed code is gone");
+	check(findCode(&store, codes[1]) == 2 && findCode(&store, codes[2]) == 3, "wrapped codes are found");
+	check(store.codes[CODE_STORE_SLOTS - 1] == (uint32_t)last[1] && store.codes[0] == (uint32_t)first, "wrapped codes shift back");
+
+	check(removeCode(&store, codes[1]) == 0 && findCode(&store, codes[2]) == 3, "code of slot 0 survives");
+	check(removeCode(&store, codes[2]) == 0 && store.count == 0, "store is empty again");
+}
+
+static void checkRejects()
+{
+	struct codeStore store;
+	initCodeStore(&store);
+	check(addCode(&store, "12345", 0) < 0 && addCode(&store, "12345a", 0) < 0 && addCode(&store, "1234567", 0) < 0,
+		"malformed codes are rejected");
+	check(addCode(&store, "123456", 0) == 0 && addCode(&store, "123456", 1) < 0, "duplicate code is rejected");
+	check(removeCode(&store, "654321") < 0, "unknown code is not removed");
+
+	char code[CODE_LENGTH + 1];
+	for (int i = 0; store.count < CODE_STORE_SLOTS / 2; i++)
+	{
+		formatCode(i, code);
+		addCode(&store, code, 0);
+	}
+	formatCode(999999, code);
+	check(addCode(&store, code, 0) < 0, "half full store takes no more codes");
+}
+
+/**
+* Add and remove random codes, compare the store with an array of the codes it should keep.
+*/
+static void checkRandom()
+{
+	struct codeStore store;
+	int compartments[FUZZ_CODES];//compartment of every code kept, -1 if not kept
+	int values[FUZZ_CODES];
+	initCodeStore(&store);
+	srand(1);
+	for (int i = 0; i < FUZZ_CODES; i++)
+	{
+		compartments[i] = -1;
+		values[i] = i * 7919 % 1000000;//distinct, spread by the store's hash anyway
+	}
+
+	bool consistent = true;
+	int kept = 0;
+	for (int step = 0; step < FUZZ_STEPS && consistent; step++)
+	{
+		int i = rand() % FUZZ_CODES;
+		char code[CODE_LENGTH + 1];
+		formatCode(values[i], code);
+		if (compartments[i] < 0)
+		{
+			int compartment = rand() % 32;
+			bool added = addCode(&store, code, compartment) == 0;
+			consistent = added == (kept < CODE_STORE_SLOTS / 2);
+			if (added)
+			{
+				compartments[i] = compartment;
+				kept++;
+			}
+		}
+		else
+		{
+			consistent = removeCode(&store, code) == 0;
+			compartments[i] = -1;
+			kept--;
+		}
+
+		for (int j = 0; j < FUZZ_CODES && consistent; j++)
+		{
+			formatCode(values[j], code);
+			consistent = findCode(&store, code) == compartments[j];
+		}
+		consistent = consistent && store.count == kept;
+	}
+	check(consistent, "random adds and removes");
+}
+
+int main()
+{
+	checkWrappingChain();
+	checkRejects();
+	checkRandom();
+
+	printf("%d failure(s)\n", failures);
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+/**
+* Host check of keypad scanning against the mock keypad.
+*
+* keyboard.c runs its own thread on the mock backend while keys are pressed and released with
+* setMockKey(). Checks that presses come out of takeKeyEvent(), short bounces and ghost corners
+* don't, and an idle keypad leaves its pins alone.
+*
+* Usage: keypad_check
+* Exits with 1 if any check failed.
+*/
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "keyboard.h"
+#include "key_ring.h"
+#include "keypad_backend.h"
+#include "keypad_mock.h"
+
+#define PRESS_MS 20 /*!< Debounce press time, far above the bounce so a busy host doesn't turn it into a press. */
+#define RELEASE_MS 20 /*!< Debounce release time. */
+#define SETTLE_MS 100 /*!< Longer than debouncing and backing off to idle. */
+
+static int failures = 0;
+
+/**
+* Wait without clock_nanosleep(), recorder.c replaces it for the benchmark.
+*/
+static void waitMs(int ms)
+{
+	poll(NULL, 0, ms);
+}
+
+static void check(bool passed, const char *what)
+{
+	printf("%-40s %s\n", what, passed ? "ok" : "FAILED");
+	if (!passed)
+		failures++;
+}
+
+/**
+* Take every pressed key.
+*
+* @param keys Set to the keys in the order they were pressed.
+* @param size Size of keys including terminator.
+* @return Number of keys taken.
+*/
+static int takeKeys(char *keys, int size)
+{
+	int count = 0;
+	struct keyEvent event;
+	while (takeKeyEvent(&event) > 0)
+	{
+		if (count < size - 1)
+			keys[count++] = event.key;
+	}
+	keys[count] = '\0';
+	return count;
+}
+
+static void checkPress()
+{
+	char keys[8];
+	setMockKey(0, 0, true);
+	waitMs(SETTLE_MS);
+	setMockKey(0, 0, false);
+	waitMs(SETTLE_MS);
+	check(takeKeys(keys, sizeof(keys)) == 1 && keys[0] == '1', "press is taken once");
+}
+
+static void checkBounce()
+{
+	char keys[8];
+	setMockKey(1, 1, true);
+	waitMs(1);
+	setMockKey(1, 1, false);
+	waitMs(SETTLE_MS);
+	check(takeKeys(keys, sizeof(keys)) == 0, "1 ms bounce is rejected");
+}
+
+/**
+* Hold three corners of a rectangle, the fourth one reads down too and must not be reported.
+*/
+static void checkGhost()
+{
+	char keys[8];
+	setMockKey(0, 0, true);
+	waitMs(SETTLE_MS);
+	setMockKey(0, 1, true);
+	waitMs(SETTLE_MS);
+	setMockKey(1, 0, true);
+	waitMs(SETTLE_MS);
+	setMockKey(0, 0, false);
+	setMockKey(0, 1, false);
+	setMockKey(1, 0, false);
+	waitMs(SETTLE_MS);
+
+	int count = takeKeys(keys, sizeof(keys));
+	bool hasGhost = false;
+	for (int i = 0; i < count; i++)
+		hasGhost |= keys[i] == '5';
+	check(count == 2 && keys[0] == '1' && keys[1] == '2', "held corners are taken in order");
+	check(!hasGhost, "ghost corner is suppressed");
+}
+
+static void checkIdle()
+{
+	waitMs(SETTLE_MS);
+	long before = getMockKeypadAccesses();
+	waitMs(10 * SETTLE_MS);
+	check(getMockKeypadAccesses() == before, "idle keypad makes no pin accesses");
+}
+
+int main()
+{
+	setKeypadBackend(&mockKeypadBackend);
+	if (setKeypadDebounce(PRESS_MS, RELEASE_MS) < 0 || initKeyboard() < 0)
+	{
+		fprintf(stderr, "keyboard failed to start\n");
+		return 1;
+	}
+
+	checkPress();
+	checkBounce();
+	checkGhost();
+	checkIdle();
+	check(getDroppedKeyCount() == 0, "no press was dropped");
+
+	cleanupKeyboard();
+	printf("%d failure(s)\n", failures);
+	return failures > 0 ? 1 : 0;
+}
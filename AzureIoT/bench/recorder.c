@@ -0,0 +1,167 @@
+#include "recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/log.h>
+#include <applibs/gpio.h>
+#include <applibs/spi.h>
+
+#define GPIO_COUNT 128 /*!< GPIOs of the MT3620, fd of a GPIO is its number plus GPIO_FD_BASE. */
+#define GPIO_FD_BASE 100 /*!< Keeps GPIO fds away from real ones like epoll. */
+#define SPI_FD 90 /*!< Fd returned for the SPI master. */
+#define DISPLAY_MODE_PIN 42 /*!< GPIO switching the display between commands and data. */
+
+static struct recording current; /*!< Counters since last reset. */
+static uint8_t gpioValues[GPIO_COUNT]; /*!< Last written or configured value of every GPIO. */
+
+/**
+* Clear all counters.
+*/
+void resetRecording()
+{
+	memset(&current, 0, sizeof(current));
+}
+
+/**
+* Get counters collected since last reset.
+*/
+struct recording getRecording()
+{
+	return current;
+}
+
+/**
+* Set value read from input GPIO.
+*
+* @param gpioId Number of the GPIO.
+* @param value GPIO_Value_Low or GPIO_Value_High.
+*/
+void setGpioInput(int gpioId, uint8_t value)
+{
+	if (gpioId >= 0 && gpioId < GPIO_COUNT)
+		gpioValues[gpioId] = value;
+}
+
+void Log_Debug(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode, GPIO_Value_Type initialValue)
+{
+	(void)outputMode;
+	if (gpioId < 0 || gpioId >= GPIO_COUNT)
+		return -1;
+
+	gpioValues[gpioId] = initialValue;
+	return GPIO_FD_BASE + gpioId;
+}
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+	if (gpioId < 0 || gpioId >= GPIO_COUNT)
+		return -1;
+
+	return GPIO_FD_BASE + gpioId;
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+	int gpioId = gpioFd - GPIO_FD_BASE;
+	if (gpioId < 0 || gpioId >= GPIO_COUNT)
+		return -1;
+
+	if (gpioId == DISPLAY_MODE_PIN && gpioValues[gpioId] != value)
+		current.modeToggles++;
+
+	gpioValues[gpioId] = value;
+	return 0;
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue)
+{
+	int gpioId = gpioFd - GPIO_FD_BASE;
+	if (gpioId < 0 || gpioId >= GPIO_COUNT)
+		return -1;
+
+	*outValue = gpioValues[gpioId];
+	return 0;
+}
+
+int SPIMaster_InitConfig(SPIMaster_Config *config)
+{
+	memset(config, 0, sizeof(*config));
+	return 0;
+}
+
+int SPIMaster_Open(SPI_InterfaceId interfaceId, SPI_ChipSelectId chipSelectId, const SPIMaster_Config *config)
+{
+	(void)interfaceId;
+	(void)chipSelectId;
+	(void)config;
+	return SPI_FD;
+}
+
+int SPIMaster_SetBusSpeed(int fd, uint32_t speedInHz)
+{
+	(void)speedInHz;
+	return fd == SPI_FD ? 0 : -1;
+}
+
+int SPIMaster_InitTransfers(SPIMaster_Transfer *transfers, size_t transferCount)
+{
+	memset(transfers, 0, transferCount * sizeof(*transfers));
+	return 0;
+}
+
+/**
+* Record transfers, rejects the same things the real driver does.
+*/
+ssize_t SPIMaster_TransferSequential(int fd, const SPIMaster_Transfer *transfers, size_t transferCount)
+{
+	if (fd != SPI_FD)
+		return -1;
+
+	ssize_t length = 0;
+	for (size_t i = 0; i < transferCount; i++)
+	{
+		if (transfers[i].length == 0 || transfers[i].length > 4096 || transfers[i].writeData == NULL)
+			return -1;
+		length += transfers[i].length;
+	}
+
+	current.calls++;
+	current.transfers += transferCount;
+	current.bytes += length;
+	return length;
+}
+
+/**
+* Record sleep instead of sleeping, takes precedence over the C library function when linked in.
+*/
+int clock_nanosleep(clockid_t clockId, int flags, const struct timespec *request, struct timespec *remain)
+{
+	(void)remain;
+	struct timespec duration = *request;
+	if (flags & TIMER_ABSTIME)
+	{
+		struct timespec now;
+		clock_gettime(clockId, &now);
+		duration.tv_sec -= now.tv_sec;
+		duration.tv_nsec -= now.tv_nsec;
+	}
+
+	long us = duration.tv_sec * 1000000L + duration.tv_nsec / 1000;
+	if (us > 0)
+		current.waitUs += us;
+
+	return 0;
+}
+
+void SendTelemetry(const unsigned char *key, const unsigned char *value)
+{
+	(void)key;
+	(void)value;
+}
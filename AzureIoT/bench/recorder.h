@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+/**
+* What reached the peripherals since the last resetRecording().
+*/
+struct recording {
+	long calls; /**< SPIMaster_TransferSequential calls. */
+	long transfers; /**< Individual transfers in those calls. */
+	long bytes; /**< Bytes written to the bus. */
+	long modeToggles; /**< Changes of the display mode pin. */
+	long waitUs; /**< Time the driver asked to sleep for controller settle deadlines. */
+};
+
+void resetRecording();
+struct recording getRecording();
+void setGpioInput(int gpioId, uint8_t value);
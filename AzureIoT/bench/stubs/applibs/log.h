@@ -0,0 +1,7 @@
+#pragma once
+#include <stdarg.h>
+
+/**
+* Host stand-in for applibs/log.h, used only by the benchmark.
+*/
+void Log_Debug(const char *fmt, ...);
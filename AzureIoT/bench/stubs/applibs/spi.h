@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+* Host stand-in for applibs/spi.h, used only by the benchmark. Transfers are recorded by recorder.c.
+*/
+typedef int SPI_InterfaceId;
+typedef int SPI_ChipSelectId;
+
+typedef uint8_t SPI_ChipSelectPolarity;
+enum {
+	SPI_ChipSelectPolarity_Invalid = 0,
+	SPI_ChipSelectPolarity_ActiveLow = 1,
+	SPI_ChipSelectPolarity_ActiveHigh = 2
+};
+
+typedef uint8_t SPI_TransferFlags;
+enum {
+	SPI_TransferFlags_None = 0,
+	SPI_TransferFlags_Read = 1,
+	SPI_TransferFlags_Write = 2
+};
+
+typedef struct {
+	uint32_t z__magicAndVersion;
+	SPI_ChipSelectPolarity csPolarity;
+} SPIMaster_Config;
+
+typedef struct {
+	uint32_t z__magicAndVersion;
+	SPI_TransferFlags flags;
+	const uint8_t *writeData;
+	uint8_t *readData;
+	size_t length;
+} SPIMaster_Transfer;
+
+int SPIMaster_InitConfig(SPIMaster_Config *config);
+int SPIMaster_Open(SPI_InterfaceId interfaceId, SPI_ChipSelectId chipSelectId, const SPIMaster_Config *config);
+int SPIMaster_SetBusSpeed(int fd, uint32_t speedInHz);
+int SPIMaster_InitTransfers(SPIMaster_Transfer *transfers, size_t transferCount);
+ssize_t SPIMaster_TransferSequential(int fd, const SPIMaster_Transfer *transfers, size_t transferCount);
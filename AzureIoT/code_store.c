@@ -0,0 +1,130 @@
+#include "code_store.h"
+
+#define SLOT_EMPTY 0xFFFFFFFFu /*!< Free slot, ends every probe. */
+#define SLOT_MASK (CODE_STORE_SLOTS - 1)
+
+/**
+* Get numeric value of a code.
+*
+* @return Value or SLOT_EMPTY if code doesn't have CODE_LENGTH digits.
+*/
+static uint32_t parseCode(const char *code)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < CODE_LENGTH; i++)
+	{
+		if (code[i] < '0' || code[i] > '9')
+			return SLOT_EMPTY;
+		value = value * 10 + (code[i] - '0');
+	}
+	return code[CODE_LENGTH] == '\0' ? value : SLOT_EMPTY;
+}
+
+/**
+* Get first slot of a code, Fibonacci hashing spreads neighbouring codes over the whole table.
+*/
+static unsigned getHome(uint32_t value)
+{
+	return (value * 2654435769u) >> (32 - CODE_STORE_BITS);
+}
+
+/**
+* Find slot holding a code.
+*
+* @return Slot or -1 if the code isn't kept.
+*/
+static int findSlot(const struct codeStore *store, uint32_t value)
+{
+	unsigned slot = getHome(value);
+	for (int i = 0; i < CODE_STORE_SLOTS; i++, slot = (slot + 1) & SLOT_MASK)
+	{
+		if (store->codes[slot] == value)
+			return (int)slot;
+		if (store->codes[slot] == SLOT_EMPTY)
+			return -1;
+	}
+	return -1;
+}
+
+void initCodeStore(struct codeStore *store)
+{
+	for (int i = 0; i < CODE_STORE_SLOTS; i++)
+		store->codes[i] = SLOT_EMPTY;
+	store->count = 0;
+}
+
+/**
+* Keep a code of a compartment.
+*
+* @param store Store to add to.
+* @param code CODE_LENGTH digits.
+* @param compartment Compartment the code opens.
+* @return 0 or -1 if code is malformed, already kept or the store is half full.
+*/
+int addCode(struct codeStore *store, const char *code, int compartment)
+{
+	uint32_t value = parseCode(code);
+	if (value == SLOT_EMPTY || compartment < 0 || compartment > UINT8_MAX || findSlot(store, value) >= 0)
+		return -1;
+
+	//probes stay short only while at least half of the slots are free
+	if (store->count >= CODE_STORE_SLOTS / 2)
+		return -1;
+
+	unsigned slot = getHome(value);
+	while (store->codes[slot] != SLOT_EMPTY)
+		slot = (slot + 1) & SLOT_MASK;
+
+	store->codes[slot] = value;
+	store->compartments[slot] = (uint8_t)compartment;
+	store->count++;
+	return 0;
+}
+
+/**
+* Look up compartment a code opens.
+*
+* @return Compartment or -1 if no compartment has the code.
+*/
+int findCode(const struct codeStore *store, const char *code)
+{
+	uint32_t value = parseCode(code);
+	if (value == SLOT_EMPTY)
+		return -1;
+
+	int slot = findSlot(store, value);
+	return slot < 0 ? -1 : store->compartments[slot];
+}
+
+/**
+* Forget a code.
+*
+* Codes probed past the freed slot are shifted back into it, so no removed markers pile up and probes
+* stay as short as if the code was never added.
+*
+* @return 0 or -1 if the code wasn't kept.
+*/
+int removeCode(struct codeStore *store, const char *code)
+{
+	uint32_t value = parseCode(code);
+	int slot = value == SLOT_EMPTY ? -1 : findSlot(store, value);
+	if (slot < 0)
+		return -1;
+
+	unsigned hole = (unsigned)slot;
+	for (unsigned next = (hole + 1) & SLOT_MASK; store->codes[next] != SLOT_EMPTY; next = (next + 1) & SLOT_MASK)
+	{
+		//code can fill the hole only if its probe passed through it
+		unsigned home = getHome(store->codes[next]);
+		if (((next - home) & SLOT_MASK) >= ((next - hole) & SLOT_MASK))
+		{
+			store->codes[hole] = store->codes[next];
+			store->compartments[hole] = store->compartments[next];
+			hole = next;
+		}
+	}
+
+	store->codes[hole] = SLOT_EMPTY;
+	store->count--;
+	return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CODE_LENGTH 6 /*!< Number of digits of a code. */
+
+#ifndef CODE_STORE_BITS
+#define CODE_STORE_BITS 6 /*!< Store has 1 << CODE_STORE_BITS slots, at least twice the number of codes kept. */
+#endif
+
+#define CODE_STORE_SLOTS (1 << CODE_STORE_BITS)
+
+/**
+* Open addressed hash table from codes to compartments.
+*
+* Codes are kept as their numeric value, a slot takes 5 bytes and a lookup probes a few neighbouring slots.
+*/
+struct codeStore {
+	uint32_t codes[CODE_STORE_SLOTS]; /**< Numeric value of the code in every slot or a free marker. */
+	uint8_t compartments[CODE_STORE_SLOTS]; /**< Compartment of the code in the same slot. */
+	int count; /**< Number of codes kept. */
+};
+
+void initCodeStore(struct codeStore *store);
+int addCode(struct codeStore *store, const char *code, int compartment);
+int findCode(const struct codeStore *store, const char *code);
+int removeCode(struct codeStore *store, const char *code);
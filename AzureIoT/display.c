@@ -1,9 +1,13 @@
 #include "display.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include <applibs/log.h>
 #include <applibs/gpio.h>
@@ -13,7 +17,8 @@
 
 #include "epoll_timerfd_utilities.h"
 
-#include "font.h"
+#include "glyph.h"
+#include "spi_queue.h"
 
 static int spiFd = -1; /*!< File descriptor for SPI peripheral. */
 static int modePinFd = -1; /*!< File descriptor for mode selection pin LOW for command, HIGH for data. */
@@ -23,21 +28,74 @@ static const int modePin = 42; /*!< number of GPIO for mode pin. */
 static const int resetPin = 16; /*!< number of GPIO for reset pin. */
 
 /**
-* Compares expected number of bytes to be send through SPI with actual number of bytes sent through SPI.
-*
-* @param expectedBytes number of expected bytes to be send through SPI.
-* @param actualBytes number of actual bytes sent through SPI.
+* Remap setting (0xA0) without color depth bits, bit 5 enables COM odd/even split like before.
+* Bits 7:6 = 01 select 65k color (RGB565 GRAM writes) and 00 select 256 color (RGB332).
 */
-static bool CheckTransferSize(size_t expectedBytes, ssize_t actualBytes)
-{
-	if (actualBytes < 0)
-		return false;
+static const uint8_t remapSetting = 0b00100000;
 
-	if (actualBytes != (ssize_t)expectedBytes)
-		return false;
+/**
+* Colors used by the UI with hand picked RGB332 equivalents, nearest level of every channel
+* would turn the dark gray line purple as blue has only 4 levels.
+*/
+static const struct {
+	uint32_t color;
+	uint8_t rgb332;
+} palette[] = {
+	{ 0xFFFFFF, 0b11111111 },
+	{ 0xba9b02, 0b10110000 },
+	{ 0x404040, 0b01001001 },
+	{ 0x36342e, 0b00100100 },
+};
 
-	return true;
-}
+static int colorDepth = 16; /*!< Bits per pixel of GRAM writes, 16 for RGB565 or 8 for RGB332. */
+
+#define MAX_DIRTY_RECTS 4 /*!< Maximum number of separate regions pushed to the panel by one flush. */
+#define MAX_PANEL_OPERATIONS 8 /*!< Maximum number of controller commands kept until the next flush. */
+
+/**
+* Inclusive region of the framebuffer that differs from the panel.
+*/
+struct dirtyRect {
+	int startX; /**< Leftmost column. */
+	int startY; /**< Topmost row. */
+	int endX; /**< Rightmost column. */
+	int endY; /**< Bottom row. */
+};
+
+static bool framebufferMode = false; /*!< When true primitives draw into frameBuffer and flushDisplay() updates the panel. */
+static uint16_t frameBuffers[2][DISPLAY_HEIGHT][DISPLAY_WIDTH]; /*!< RGB565 frames, second one is used only by the render thread. */
+static uint16_t (*panelFrameBuffer)[DISPLAY_WIDTH] = frameBuffers[0]; /*!< Frame being drawn, becomes panel contents on next flush. */
+static uint16_t (*frameBuffer)[DISPLAY_WIDTH] = frameBuffers[0]; /*!< Buffer primitives currently draw into. */
+static struct dirtyRect dirtyRects[MAX_DIRTY_RECTS]; /*!< Regions to be pushed on next flush. */
+static int dirtyRectCount = 0; /*!< Number of valid entries in dirtyRects. */
+
+/**
+* Controller command, like a color depth change, sent before dirty regions are written.
+*/
+struct panelOperation {
+	uint8_t command[7]; /**< Command bytes. */
+	uint8_t length; /**< Number of bytes in command. */
+	int settleUs; /**< Time controller needs to execute the command. */
+};
+
+static struct panelOperation panelOperations[MAX_PANEL_OPERATIONS]; /*!< Commands to be executed on next flush. */
+static int panelOperationCount = 0; /*!< Number of valid entries in panelOperations. */
+static int fillRectangleSetting = -1; /*!< Last value sent with fill enable command or -1 if unknown. */
+
+static bool renderThreadRunning = false; /*!< True if flushes are handed over to the render thread. */
+static pthread_t renderThread; /*!< Thread sending frames to the display. */
+static pthread_mutex_t renderMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Guards every render* variable below. */
+static pthread_cond_t renderCondition = PTHREAD_COND_INITIALIZER; /*!< Signaled when frame is handed over or thread should stop. */
+static int renderEventFd = -1; /*!< Event written by the render thread after every frame. */
+static bool renderBusy = false; /*!< True from handing frame over until it is on the display. */
+static bool renderStop = false; /*!< Set to make the render thread exit. */
+static bool renderFailed = false; /*!< Set if render thread failed to send a frame. */
+static uint16_t (*renderFrame)[DISPLAY_WIDTH] = NULL; /*!< Frame being sent by the render thread. */
+static struct dirtyRect renderRects[MAX_DIRTY_RECTS]; /*!< Regions of renderFrame to be sent. */
+static int renderRectCount = 0; /*!< Number of valid entries in renderRects. */
+static struct panelOperation renderOperations[MAX_PANEL_OPERATIONS]; /*!< Commands to be executed by the render thread. */
+static int renderOperationCount = 0; /*!< Number of valid entries in renderOperations. */
+static int renderColorDepth = 16; /*!< Color depth renderFrame is sent with. */
 
 /**
 * Structure that holds color in three bytes: red, blue and green.
@@ -70,30 +128,82 @@ static struct colorStruct hexToColor(uint32_t color)
 }
 
 /**
-* Set modePin to low so display awaits commands.
+* Converts hexadecimal color value to RGB565 used by the framebuffer.
+*
+* @param color Hexadecimal color to be converted.
+* @return Converted color.
+*/
+static uint16_t hexToRgb565(uint32_t color)
+{
+	uint16_t r = (color >> 19) & 0x1F;
+	uint16_t g = (color >> 10) & 0x3F;
+	uint16_t b = (color >> 3) & 0x1F;
+
+	return (r << 11) | (g << 5) | b;
+}
+
+/**
+* Convert RGB565 color to RGB332 used in 256 color mode.
+*
+* Colors of the palette use their hand picked equivalents, the rest is rounded to the nearest level of every channel.
 */
-static int displayCommandMode()
+static uint8_t rgb565ToRgb332(uint16_t color)
 {
-	return GPIO_SetValue(modePinFd, GPIO_Value_Low);
+	for (size_t i = 0; i < sizeof(palette) / sizeof(palette[0]); i++)
+	{
+		if (hexToRgb565(palette[i].color) == color)
+			return palette[i].rgb332;
+	}
+
+	int r = ((color >> 11) * 7 + 15) / 31;
+	int g = (((color >> 5) & 0x3F) * 7 + 31) / 63;
+	int b = ((color & 0x1F) * 3 + 15) / 31;
+
+	return (r << 5) | (g << 2) | b;
 }
 
 /**
-* Set modePin to high so display awaits data to be filled in RAM.
+* Get remap setting (0xA0) selecting given color depth.
 */
-static int displayDataMode()
+static uint8_t getRemapSetting(int depth)
 {
-	return GPIO_SetValue(modePinFd, GPIO_Value_High);
+	return remapSetting | (depth == 8 ? 0b00000000 : 0b01000000);
 }
 
 /**
-* Wait given amount of microseconds
+* Convert pixels into bytes of a GRAM write, big endian RGB565 or RGB332 for 8 bit color depth.
 *
-* @param us Number of microseconds to wait.
+* @param data Buffer to write into.
+* @param pixels RGB565 pixels.
+* @param count Number of pixels.
+* @param depth Color depth, 8 or 16.
+* @return Pointer right after the last written byte.
 */
-static void wait(int us)
+static uint8_t* packPixels(uint8_t* data, const uint16_t* pixels, int count, int depth)
 {
-	const struct timespec sleepTime = { 0, 1000 * us };
-	nanosleep(&sleepTime, NULL);
+	if (depth != 8)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			*data++ = pixels[i] >> 8;
+			*data++ = pixels[i] & 0xFF;
+		}
+		return data;
+	}
+
+	//screens are mostly runs of the same color so conversion is done once per run
+	uint16_t last = pixels[0];
+	uint8_t converted = rgb565ToRgb332(last);
+	for (int i = 0; i < count; i++)
+	{
+		if (pixels[i] != last)
+		{
+			last = pixels[i];
+			converted = rgb565ToRgb332(last);
+		}
+		*data++ = converted;
+	}
+	return data;
 }
 
 /**
@@ -104,27 +214,14 @@ static void wait(int us)
 */
 static int shouldFillRectangle(bool fill)
 {
-	if(displayCommandMode() < 0)
-		return -1;
-
-	const size_t transferCount = 1;
-	SPIMaster_Transfer transfer;
-
-	int result = SPIMaster_InitTransfers(&transfer, transferCount);
-	if (result != 0)
-		return -1;
+	if (fillRectangleSetting == fill)//controller keeps the setting so send it only when it changes
+		return 0;
 
 	const uint8_t command[] = { 0x26, (char)fill };
-	transfer.flags = SPI_TransferFlags_Write;
-	transfer.writeData = command;
-	transfer.length = sizeof(command);
-
-	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
-
-	if (!CheckTransferSize(transfer.length, transferredBytes))
+	if (queueSpiCommand(command, sizeof(command), 0) < 0)
 		return -1;
 
-	wait(5);
+	fillRectangleSetting = fill;
 
 	return 0;
 }
@@ -152,6 +249,439 @@ static int resetDisplay()
 	return 0;
 }
 
+/**
+* Check whether two regions overlap or touch each other.
+*/
+static bool dirtyRectsTouch(const struct dirtyRect* a, const struct dirtyRect* b)
+{
+	return a->startX <= b->endX + 1 && b->startX <= a->endX + 1 && a->startY <= b->endY + 1 && b->startY <= a->endY + 1;
+}
+
+/**
+* Get smallest region that contains both given regions.
+*/
+static struct dirtyRect dirtyRectsUnion(const struct dirtyRect* a, const struct dirtyRect* b)
+{
+	struct dirtyRect r;
+	r.startX = a->startX < b->startX ? a->startX : b->startX;
+	r.startY = a->startY < b->startY ? a->startY : b->startY;
+	r.endX = a->endX > b->endX ? a->endX : b->endX;
+	r.endY = a->endY > b->endY ? a->endY : b->endY;
+	return r;
+}
+
+static int dirtyRectArea(const struct dirtyRect* r)
+{
+	return (r->endX - r->startX + 1) * (r->endY - r->startY + 1);
+}
+
+/**
+* Add region to the list of regions that have to be pushed to the panel on next flush.
+* Does nothing while drawing into offscreen buffer.
+* Touching regions are merged and when there is no free slot left the region is merged
+* with the one that grows the least, so flush never needs more than MAX_DIRTY_RECTS writes.
+*
+* @param startX Leftmost column of the region.
+* @param startY Topmost row of the region.
+* @param endX Rightmost column of the region.
+* @param endY Bottom row of the region.
+*/
+static void markDirty(int startX, int startY, int endX, int endY)
+{
+	if (frameBuffer != panelFrameBuffer)//offscreen drawing never reaches the panel
+		return;
+
+	if (startX < 0)
+		startX = 0;
+	if (startY < 0)
+		startY = 0;
+	if (endX > DISPLAY_WIDTH - 1)
+		endX = DISPLAY_WIDTH - 1;
+	if (endY > DISPLAY_HEIGHT - 1)
+		endY = DISPLAY_HEIGHT - 1;
+	if (startX > endX || startY > endY)
+		return;
+
+	struct dirtyRect r = { startX, startY, endX, endY };
+
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (int i = 0; i < dirtyRectCount; i++)
+		{
+			if (dirtyRectsTouch(&dirtyRects[i], &r))
+			{
+				r = dirtyRectsUnion(&dirtyRects[i], &r);
+				dirtyRects[i] = dirtyRects[--dirtyRectCount];//remove absorbed region and look again as union could touch others now
+				merged = true;
+				break;
+			}
+		}
+
+		if (!merged && dirtyRectCount == MAX_DIRTY_RECTS)
+		{
+			int best = 0;
+			int bestGrowth = -1;
+			for (int i = 0; i < dirtyRectCount; i++)
+			{
+				struct dirtyRect u = dirtyRectsUnion(&dirtyRects[i], &r);
+				int growth = dirtyRectArea(&u) - dirtyRectArea(&dirtyRects[i]);
+				if (bestGrowth < 0 || growth < bestGrowth)
+				{
+					best = i;
+					bestGrowth = growth;
+				}
+			}
+			r = dirtyRectsUnion(&dirtyRects[best], &r);
+			dirtyRects[best] = dirtyRects[--dirtyRectCount];
+			merged = true;
+		}
+	}
+
+	dirtyRects[dirtyRectCount++] = r;
+}
+
+/**
+* Fill region of the framebuffer with given color. Coordinates are inclusive and get clipped to the screen.
+*/
+static void fillFramebuffer(int startX, int startY, int endX, int endY, uint16_t color)
+{
+	if (startX < 0)
+		startX = 0;
+	if (startY < 0)
+		startY = 0;
+	if (endX > DISPLAY_WIDTH - 1)
+		endX = DISPLAY_WIDTH - 1;
+	if (endY > DISPLAY_HEIGHT - 1)
+		endY = DISPLAY_HEIGHT - 1;
+
+	for (int y = startY; y <= endY; y++)
+		for (int x = startX; x <= endX; x++)
+			frameBuffer[y][x] = color;
+
+	markDirty(startX, startY, endX, endY);
+}
+
+/**
+* Set column and row address window so data written to GRAM fills only given region.
+*
+* @param startX Leftmost column of the window.
+* @param startY Topmost row of the window.
+* @param endX Rightmost column of the window.
+* @param endY Bottom row of the window.
+* @return 0 or -1 if something went wrong.
+*/
+static int setWindow(int startX, int startY, int endX, int endY)
+{
+	const uint8_t command[] = { 0x15, startX, endX, 0x75, startY, endY };
+	return queueSpiCommand(command, sizeof(command), 0);
+}
+
+/**
+* Queue region of a frame as a single windowed GRAM write.
+*
+* @param frame Frame to take pixels from.
+* @param r Region to be written.
+* @param depth Color depth the panel is set to.
+* @return 0 or -1 if something went wrong.
+*/
+static int writeRegionToPanel(uint16_t (*frame)[DISPLAY_WIDTH], const struct dirtyRect* r, int depth)
+{
+	if (setWindow(r->startX, r->startY, r->endX, r->endY) < 0)
+		return -1;
+
+	int width = r->endX - r->startX + 1;
+	uint8_t* data = queueSpiData(width * (r->endY - r->startY + 1) * depth / 8);
+	if (data == NULL)
+		return -1;
+
+	for (int y = r->startY; y <= r->endY; y++)
+		data = packPixels(data, &frame[y][r->startX], width, depth);
+
+	return 0;
+}
+
+/**
+* Queue controller commands followed by regions of a frame.
+*
+* @param frame Frame to take pixels from.
+* @param operations Commands to be executed before regions are written.
+* @param operationCount Number of commands.
+* @param rects Regions to be written.
+* @param rectCount Number of regions.
+* @param depth Color depth the panel is set to once operations are executed.
+* @return 0 or -1 if something went wrong.
+*/
+static int writeFrameToPanel(uint16_t (*frame)[DISPLAY_WIDTH], const struct panelOperation* operations, int operationCount, const struct dirtyRect* rects, int rectCount, int depth)
+{
+	for (int i = 0; i < operationCount; i++)
+	{
+		if (queueSpiCommand(operations[i].command, operations[i].length, operations[i].settleUs) < 0)
+			return -1;
+	}
+
+	for (int i = 0; i < rectCount; i++)
+	{
+		if (writeRegionToPanel(frame, &rects[i], depth) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+* Enable or disable framebuffer mode.
+*
+* In framebuffer mode all primitives draw into RAM and nothing is sent to the display until flushDisplay() is called.
+* Enabling marks the whole screen dirty so the panel gets synchronized with the framebuffer on next flush.
+*
+* @param enabled Set to true to draw into the framebuffer.
+*/
+void setFramebufferMode(bool enabled)
+{
+	framebufferMode = enabled;
+	frameBuffer = panelFrameBuffer;
+	dirtyRectCount = 0;
+	panelOperationCount = 0;
+	if (enabled)
+		markDirty(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+}
+
+/**
+* Redirect primitives to an offscreen buffer.
+*
+* Works only in framebuffer mode. Drawing into offscreen buffer doesn't mark anything dirty.
+*
+* @param buffer DISPLAY_WIDTH * DISPLAY_HEIGHT RGB565 pixels, row after row, or NULL to draw into the framebuffer again.
+* @return 0 or -1 if framebuffer mode is disabled.
+*/
+int setRenderTarget(uint16_t* buffer)
+{
+	if (!framebufferMode)
+		return -1;
+
+	frameBuffer = buffer == NULL ? panelFrameBuffer : (uint16_t(*)[DISPLAY_WIDTH])buffer;
+	return 0;
+}
+
+/**
+* Get buffer primitives currently draw into.
+*
+* @return DISPLAY_WIDTH * DISPLAY_HEIGHT RGB565 pixels, row after row.
+*/
+uint16_t* getRenderTarget()
+{
+	return &frameBuffer[0][0];
+}
+
+/**
+* Mark region of the framebuffer as changed after it was modified through getRenderTarget().
+*
+* @param startX Leftmost column of the region.
+* @param startY Topmost row of the region.
+* @param endX Rightmost column of the region.
+* @param endY Bottom row of the region.
+*/
+void invalidateRegion(int startX, int startY, int endX, int endY)
+{
+	markDirty(startX, startY, endX, endY);
+}
+
+/**
+* Hand dirty regions of the frame over to the render thread.
+*
+* If the thread is still busy with previous frame nothing happens and regions stay dirty,
+* they are handed over by acknowledgeRenderCompletion() once the thread is done.
+* After hand over primitives draw into the other frame which starts as a copy of the handed one.
+*
+* @return 0 or -1 if render thread failed.
+*/
+static int presentFrame()
+{
+	pthread_mutex_lock(&renderMutex);
+
+	if (renderFailed)
+	{
+		pthread_mutex_unlock(&renderMutex);
+		return -1;
+	}
+
+	if (renderBusy || (panelOperationCount == 0 && dirtyRectCount == 0))
+	{
+		pthread_mutex_unlock(&renderMutex);
+		return 0;
+	}
+
+	memcpy(renderOperations, panelOperations, sizeof(panelOperations));
+	renderOperationCount = panelOperationCount;
+	renderColorDepth = colorDepth;
+	panelOperationCount = 0;
+
+	memcpy(renderRects, dirtyRects, sizeof(dirtyRects));
+	renderRectCount = dirtyRectCount;
+	dirtyRectCount = 0;
+
+	renderFrame = panelFrameBuffer;
+	panelFrameBuffer = panelFrameBuffer == frameBuffers[0] ? frameBuffers[1] : frameBuffers[0];
+	memcpy(panelFrameBuffer, renderFrame, sizeof(frameBuffers[0]));
+	frameBuffer = panelFrameBuffer;
+
+	renderBusy = true;
+	pthread_cond_signal(&renderCondition);
+	pthread_mutex_unlock(&renderMutex);
+
+	return 0;
+}
+
+/**
+* Send everything drawn since last flush to the display.
+*
+* In framebuffer mode every dirty region is written to the panel, otherwise queued commands are submitted.
+* When render thread is running the frame is handed over to it and this returns without waiting for SPI.
+* @return 0 or -1 if something went wrong.
+*/
+int flushDisplay()
+{
+	if (renderThreadRunning)
+		return presentFrame();
+
+	if (framebufferMode)
+	{
+		if (writeFrameToPanel(panelFrameBuffer, panelOperations, panelOperationCount, dirtyRects, dirtyRectCount, colorDepth) < 0)
+			return -1;
+
+		panelOperationCount = 0;
+		dirtyRectCount = 0;
+	}
+
+	return submitSpiQueue();
+}
+
+/**
+* Body of the render thread, sends every handed over frame and signals renderEventFd when done.
+*/
+static void* renderThreadMain(void* arg)
+{
+	pthread_mutex_lock(&renderMutex);
+	while (true)
+	{
+		while (!renderBusy && !renderStop)
+			pthread_cond_wait(&renderCondition, &renderMutex);
+
+		if (!renderBusy)//stop requested and there is no frame left to send
+			break;
+
+		pthread_mutex_unlock(&renderMutex);
+
+		//frame and regions are not touched by anyone else while renderBusy is set
+		int result = writeFrameToPanel(renderFrame, renderOperations, renderOperationCount, renderRects, renderRectCount, renderColorDepth);
+
+		if (submitSpiQueue() < 0)
+			result = -1;
+
+		pthread_mutex_lock(&renderMutex);
+		renderBusy = false;
+		if (result < 0)
+			renderFailed = true;
+
+		uint64_t event = 1;
+		if (write(renderEventFd, &event, sizeof(event)) != sizeof(event))
+			renderFailed = true;
+	}
+	pthread_mutex_unlock(&renderMutex);
+
+	return NULL;
+}
+
+/**
+* Start sending frames from a separate thread so flushDisplay() never waits for SPI.
+*
+* Works only in framebuffer mode, display must not be used outside of framebuffer mode until stopRenderThread().
+* Returned file descriptor becomes readable after every frame sent, register it in epoll and
+* call acknowledgeRenderCompletion() when it fires.
+*
+* @return Event file descriptor or -1 if something went wrong.
+*/
+int startRenderThread()
+{
+	if (!framebufferMode || renderThreadRunning)
+		return -1;
+
+	renderEventFd = eventfd(0, EFD_NONBLOCK);
+	if (renderEventFd < 0)
+	{
+		Log_Debug("ERROR: Could not create render event: %s (%d).\n", strerror(errno), errno);
+		return -1;
+	}
+
+	renderBusy = false;
+	renderStop = false;
+	renderFailed = false;
+
+	int result = pthread_create(&renderThread, NULL, renderThreadMain, NULL);
+	if (result != 0)
+	{
+		Log_Debug("ERROR: Could not start render thread: %s (%d).\n", strerror(result), result);
+		close(renderEventFd);
+		renderEventFd = -1;
+		return -1;
+	}
+
+	renderThreadRunning = true;
+	return renderEventFd;
+}
+
+/**
+* Handle frame completion signaled by render thread.
+*
+* Hands over regions that were flushed while the thread was busy.
+*
+* @return 0 or -1 if render thread failed.
+*/
+int acknowledgeRenderCompletion()
+{
+	uint64_t events;
+	if (read(renderEventFd, &events, sizeof(events)) < 0 && errno != EAGAIN)
+		return -1;
+
+	return presentFrame();
+}
+
+/**
+* Check whether render thread is still sending a frame.
+*
+* @return true if frame is being sent.
+*/
+bool isRenderBusy()
+{
+	pthread_mutex_lock(&renderMutex);
+	bool busy = renderBusy;
+	pthread_mutex_unlock(&renderMutex);
+
+	return busy;
+}
+
+/**
+* Stop render thread after it finishes the frame it is sending, flushes are done synchronously afterwards.
+*/
+void stopRenderThread()
+{
+	if (!renderThreadRunning)
+		return;
+
+	pthread_mutex_lock(&renderMutex);
+	renderStop = true;
+	pthread_cond_signal(&renderCondition);
+	pthread_mutex_unlock(&renderMutex);
+
+	pthread_join(renderThread, NULL);
+	renderThreadRunning = false;
+
+	CloseFdAndPrintError(renderEventFd, "Render event");
+	renderEventFd = -1;
+}
+
 /**
 * Draw one pixel on the display.
 *
@@ -162,6 +692,12 @@ static int resetDisplay()
 */
 int drawPixel(int posX, int posY, uint32_t color)
 {
+	if (framebufferMode)
+	{
+		fillFramebuffer(posX, posY, posX, posY, hexToRgb565(color));
+		return 0;
+	}
+
 	return drawRectangle(posX, posY, 0, 0, color, 0, 0);
 }
 
@@ -177,31 +713,47 @@ int drawPixel(int posX, int posY, uint32_t color)
 */
 int drawLine(int startX, int startY, int endX, int endY, uint32_t color)
 {
-	struct colorStruct c = hexToColor(color);
-
-	if(displayCommandMode() < 0)
-		return -1;
-
-	const size_t transferCount = 1;
-	SPIMaster_Transfer transfer;
+	if (framebufferMode)
+	{
+		uint16_t c = hexToRgb565(color);
+
+		//Bresenham's line algorithm
+		int dx = abs(endX - startX);
+		int dy = -abs(endY - startY);
+		int sx = startX < endX ? 1 : -1;
+		int sy = startY < endY ? 1 : -1;
+		int err = dx + dy;
+		int x = startX;
+		int y = startY;
+		while (true)
+		{
+			if (x >= 0 && x < DISPLAY_WIDTH && y >= 0 && y < DISPLAY_HEIGHT)
+				frameBuffer[y][x] = c;
+			if (x == endX && y == endY)
+				break;
+			int e2 = 2 * err;
+			if (e2 >= dy)
+			{
+				err += dy;
+				x += sx;
+			}
+			if (e2 <= dx)
+			{
+				err += dx;
+				y += sy;
+			}
+		}
 
-	int result = SPIMaster_InitTransfers(&transfer, transferCount);
-	if (result != 0) {
-		return -1;
+		markDirty(startX < endX ? startX : endX, startY < endY ? startY : endY, startX > endX ? startX : endX, startY > endY ? startY : endY);
+		return 0;
 	}
 
-	const uint8_t command[] = { 0x21, startX, startY, endX, endY, c.r, c.g, c.b };
-	transfer.flags = SPI_TransferFlags_Write;
-	transfer.writeData = command;
-	transfer.length = sizeof(command);
-
-	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
+	struct colorStruct c = hexToColor(color);
 
-	if (!CheckTransferSize(transfer.length, transferredBytes))
+	const uint8_t command[] = { 0x21, startX, startY, endX, endY, c.r, c.g, c.b };
+	if (queueSpiCommand(command, sizeof(command), 10) < 0)
 		return -1;
 
-	wait(10);
-
 	return 0;
 }
 
@@ -216,56 +768,27 @@ int drawLine(int startX, int startY, int endX, int endY, uint32_t color)
 */
 int drawChar(char c, int startX, int startY, uint32_t color)
 {
-	int fontTableCursor = START_OF_CHAR_WIDTHS;//first char's width in font table
-	fontTableCursor += c - fontTable[FIRST_CHAR];//get index of char's width of given element
-	int charWidthInWords = fontTable[fontTableCursor];//get width (number of words (16 bits)) of given element from font table
-
-	//now see how much cursor needs to jump from end of char widths part of the font table to the first byte of given character c
-	int offset = 0;
-	for (int i = fontTableCursor - 1; i >= START_OF_CHAR_WIDTHS; i--)
-	{
-		offset += fontTable[i];//add to offset width (word) of every character that is before given character c in font table
-	}
-	offset *= 2;//convert from word to byte
-
-	//get the position of the first byte of given character c in font table
-	fontTableCursor = START_OF_CHAR_WIDTHS + fontTable[CHAR_COUNT] + offset;
-
-	int maxWidth = 0;//while drawing look for true width of the given character
-
-	//probably can be done in one loop but whatever
-	for (int i = 0; i < charWidthInWords; i++)//first half of the character
-	{
-		for (int j = 0; j < 8; j++)//for every bit in byte
-		{
-			if (fontTable[fontTableCursor + i] & (1 << j))//see if current bit is set
-			{
-				if (i > maxWidth)//check if it expanded character and if so then update max width
-					maxWidth = i;
+	const struct fontGlyph *g = getGlyph(c);
+	if (g == NULL)
+		return -1;
 
-				int result = drawPixel(startX + i, startY + j - 3, color);//finally draw the pixel
-				if (result != 0)
-					return -1;
-			}
-		}
-	}
-	for (int i = charWidthInWords; i < charWidthInWords*2; i++)//second half of the character
+	struct fontDecoder decoder;
+	startGlyphDecoder(&decoder, g);
+	for (int row = 0; row < GLYPH_HEIGHT; row++)
 	{
-		for (int j = 0; j < 8; j++)//for every bit in byte
+		uint16_t bits = decodeFontRow(&decoder);
+		for (int column = 0; column < g->width; column++)//for every pixel in the row
 		{
-			if (fontTable[fontTableCursor + i] & (1 << j))//see if current bit is set
+			if (bits & (1 << column))//see if current bit is set
 			{
-				if (i - charWidthInWords > maxWidth)//check if it expanded character and if so then update max width
-					maxWidth = i - charWidthInWords;
-
-				int result = drawPixel(startX + i - charWidthInWords, startY + j, color);// finally draw the pixel
+				int result = drawPixel(startX + column, startY + row - GLYPH_TOP_OFFSET, color);//finally draw the pixel
 				if (result != 0)
 					return -1;
 			}
 		}
 	}
 
-	return maxWidth;
+	return g->width - 1;
 }
 
 /**
@@ -291,6 +814,78 @@ int drawText(const char* text, int x, int y, uint32_t color)
 	return 0;
 }
 
+/**
+* Draw character together with its background in a single transfer.
+*
+* Rows are decoded from the font one at a time straight into the framebuffer or the queued GRAM write,
+* nothing of the character is kept in RAM. Spacing after the character is not drawn and rows above
+* and below its ink are left untouched, so lines placed close to each other don't overwrite descenders.
+*
+* @param c Character to be drawn. Should be between 32 and 127.
+* @param startX Leftmost pixel of the character.
+* @param startY Topmost pixel of the character
+* @param color Color of the character.
+* @param backgroundColor Color of the pixels around the character.
+* @return width of drawn character in pixels or -1 if something went wrong.
+*/
+int drawCharWithBackground(char c, int startX, int startY, uint32_t color, uint32_t backgroundColor)
+{
+	const struct fontGlyph *g = getGlyph(c);
+	if (g == NULL)
+		return -1;
+
+	uint16_t fg = hexToRgb565(color);
+	uint16_t bg = hexToRgb565(backgroundColor);
+	int top = startY - GLYPH_TOP_OFFSET;
+
+	//only rows with ink are stored in the font, clip them and the columns to the screen
+	int startRow = g->top;
+	int endRow = g->top + g->rowCount;
+	if (top + startRow < 0)
+		startRow = -top;
+	if (top + endRow > DISPLAY_HEIGHT)
+		endRow = DISPLAY_HEIGHT - top;
+	int startColumn = startX < 0 ? -startX : 0;
+	int endColumn = startX + g->width > DISPLAY_WIDTH ? DISPLAY_WIDTH - startX : g->width;
+	if (startColumn >= endColumn || startRow >= endRow)
+		return g->width - 1;
+
+	int width = endColumn - startColumn;
+	uint8_t* data = NULL;
+	if (!framebufferMode)
+	{
+		if (setWindow(startX + startColumn, top + startRow, startX + endColumn - 1, top + endRow - 1) < 0)
+			return -1;
+
+		data = queueSpiData(width * (endRow - startRow) * colorDepth / 8);
+		if (data == NULL)
+			return -1;
+	}
+
+	struct fontDecoder decoder;
+	startGlyphDecoder(&decoder, g);
+	for (int row = 0; row < endRow; row++)
+	{
+		uint16_t bits = decodeFontRow(&decoder);//rows have to be decoded in order even if they are clipped
+		if (row < startRow)
+			continue;
+
+		uint16_t pixels[16];//one bit of the decoded row per pixel
+		for (int column = startColumn; column < endColumn; column++)
+			pixels[column - startColumn] = (bits & (1 << column)) ? fg : bg;
+
+		if (framebufferMode)
+			memcpy(&frameBuffer[top + row][startX + startColumn], pixels, width * sizeof(uint16_t));
+		else
+			data = packPixels(data, pixels, width, colorDepth);
+	}
+
+	if (framebufferMode)
+		markDirty(startX + startColumn, top + startRow, startX + endColumn - 1, top + endRow - 1);
+
+	return g->width - 1;
+}
+
 /*
 * Draw rectangle on the display.
 *
@@ -305,6 +900,23 @@ int drawText(const char* text, int x, int y, uint32_t color)
 */
 int drawRectangle(int startX, int startY, int width, int height, uint32_t color, bool fill, uint32_t fillColor)
 {
+	if (framebufferMode)
+	{
+		int endX = startX + width;
+		int endY = startY + height;
+		uint16_t c = hexToRgb565(color);
+
+		if (fill)
+			fillFramebuffer(startX + 1, startY + 1, endX - 1, endY - 1, hexToRgb565(fillColor));
+
+		//outline same way the controller draws it
+		fillFramebuffer(startX, startY, endX, startY, c);
+		fillFramebuffer(startX, endY, endX, endY, c);
+		fillFramebuffer(startX, startY, startX, endY, c);
+		fillFramebuffer(endX, startY, endX, endY, c);
+		return 0;
+	}
+
 	struct colorStruct c = hexToColor(color);
 
 	struct colorStruct f = hexToColor(fillColor);
@@ -313,28 +925,10 @@ int drawRectangle(int startX, int startY, int width, int height, uint32_t color,
 	if (result != 0)
 		return -1;
 
-	if (displayCommandMode() < 0)
-		return -1;
-
-	const size_t transferCount = 1;
-	SPIMaster_Transfer transfer;
-
-	result = SPIMaster_InitTransfers(&transfer, transferCount);
-	if (result != 0)
-		return -1;
-
 	const uint8_t command[] = { 0x22, startX, startY, startX + width, startY + height, c.r, c.g, c.b, f.r, f.g, f.b };
-	transfer.flags = SPI_TransferFlags_Write;
-	transfer.writeData = command;
-	transfer.length = sizeof(command);
-
-	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
-
-	if (!CheckTransferSize(transfer.length, transferredBytes))
+	if (queueSpiCommand(command, sizeof(command), 200) < 0)
 		return -1;
 
-	wait(200);
-
 	return 0;
 }
 
@@ -346,40 +940,79 @@ int drawRectangle(int startX, int startY, int width, int height, uint32_t color,
 */
 int fillScreen(uint32_t color)
 {
+	if (framebufferMode)
+	{
+		fillFramebuffer(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1, hexToRgb565(color));
+		return 0;
+	}
+
 	struct colorStruct c = hexToColor(color);
 
 	int result = shouldFillRectangle(true);
 	if (result != 0)
 		return -1;
 
-	if (displayCommandMode() < 0)
+	const uint8_t command[] = { 0x22, 0, 0, 95, 63, c.r, c.g, c.b, c.r, c.g, c.b };
+	if (queueSpiCommand(command, sizeof(command), 300) < 0)
 		return -1;
 
-	const size_t transferCount = 1;
-	SPIMaster_Transfer transfer;
+	return 0;
+}
 
-	result = SPIMaster_InitTransfers(&transfer, transferCount);
-	if (result != 0)
+/**
+* Keep controller command until next flush, it is sent before dirty regions are written.
+*
+* @return false if command can't be kept and caller has to mark the region dirty instead.
+*/
+static bool deferPanelOperation(const uint8_t* command, size_t length, int settleUs)
+{
+	if (frameBuffer != panelFrameBuffer || panelOperationCount == MAX_PANEL_OPERATIONS)
+		return false;
+
+	struct panelOperation* operation = &panelOperations[panelOperationCount++];
+	memcpy(operation->command, command, length);
+	operation->length = length;
+	operation->settleUs = settleUs;
+	return true;
+}
+
+/**
+* Select color depth of GRAM writes.
+*
+* 8 bit RGB332 halves the bytes of every framebuffer flush and text blit, colors of the UI map to
+* close equivalents. Primitive commands take the same colors in both depths. In framebuffer mode
+* the whole screen is written again on next flush.
+*
+* @param bitsPerPixel 16 for 65k colors or 8 for 256 colors.
+* @return 0 or -1 if depth is not supported or something went wrong.
+*/
+int setColorDepth(int bitsPerPixel)
+{
+	if (bitsPerPixel != 8 && bitsPerPixel != 16)
 		return -1;
 
-	const uint8_t command[] = { 0x22, 0, 0, 95, 63, c.r, c.g, c.b, c.r, c.g, c.b };
-	transfer.flags = SPI_TransferFlags_Write;
-	transfer.writeData = command;
-	transfer.length = sizeof(command);
+	if (bitsPerPixel == colorDepth)
+		return 0;
 
-	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
+	const uint8_t command[] = { 0xA0, getRemapSetting(bitsPerPixel) };
+	if (framebufferMode)
+	{
+		if (!deferPanelOperation(command, sizeof(command), 0))
+			return -1;
 
-	if (!CheckTransferSize(transfer.length, transferredBytes))
+		markDirty(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+	}
+	else if (queueSpiCommand(command, sizeof(command), 0) < 0)
 		return -1;
 
-	wait(300);
-
+	colorDepth = bitsPerPixel;
 	return 0;
 }
 
 /**
 * Init peripherals required for display to work.
 *
+* Outside of framebuffer mode primitives are queued and reach the display on flushDisplay().
 * Inits ISU1 SPI and two GPIO 42 and 16.
 * @return 0 or -1 if something went wrong.
 */
@@ -406,35 +1039,23 @@ int initDisplay()
 	int result = SPIMaster_SetBusSpeed(spiFd, 400000);
 	if (result != 0)
 		return -1;
+
+	initSpiQueue(spiFd, modePinFd);
 	
 	if (resetDisplay() < 0)
 		return -1;
 
-	if (displayCommandMode() < 0)
-		return -1;
-
-	const size_t transferCount = 1;
-	SPIMaster_Transfer transfer;
-
-	result = SPIMaster_InitTransfers(&transfer, transferCount);
-	if (result != 0)
-		return -1;
-
-	const uint8_t command[] = { 0xAF, 0xA0, 0b00100000 };
-	transfer.flags = SPI_TransferFlags_Write;
-	transfer.writeData = command;
-	transfer.length = sizeof(command);
+	fillRectangleSetting = -1;//reset brings controller settings back to defaults
 
-	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
-
-	if (!CheckTransferSize(transfer.length, transferredBytes))
+	const uint8_t command[] = { 0xAF, 0xA0, getRemapSetting(colorDepth) };
+	if (queueSpiCommand(command, sizeof(command), 0) < 0)
 		return -1;
 
 	result = fillScreen(0x000000);
 	if (result != 0)
 		return -1;
 
-	return 0;
+	return submitSpiQueue();
 }
 
 /**
@@ -442,6 +1063,7 @@ int initDisplay()
 */
 void cleanupDisplay()
 {
+	stopRenderThread();
 	CloseFdAndPrintError(spiFd, "Spi");
 	CloseFdAndPrintError(resetPinFd, "Reset pin");
 	CloseFdAndPrintError(modePinFd, "Mode pin");
@@ -2,12 +2,27 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define DISPLAY_WIDTH 96 /*!< Width of the panel in pixels. */
+#define DISPLAY_HEIGHT 64 /*!< Height of the panel in pixels. */
+
 int initDisplay();
 void cleanupDisplay();
 
+void setFramebufferMode(bool enabled);
+int setColorDepth(int bitsPerPixel);
+int flushDisplay();
+int startRenderThread();
+int acknowledgeRenderCompletion();
+bool isRenderBusy();
+void stopRenderThread();
+int setRenderTarget(uint16_t *buffer);
+uint16_t *getRenderTarget();
+void invalidateRegion(int startX, int startY, int endX, int endY);
+
 int drawPixel(int posX, int posY, uint32_t color);
 int drawLine(int startX, int startY, int endX, int endY, uint32_t color);
 int drawChar(char ascii, int startX, int startY, uint32_t color);
 int drawText(const char *text, int x, int y, uint32_t color);
+int drawCharWithBackground(char ascii, int startX, int startY, uint32_t color, uint32_t backgroundColor);
 int drawRectangle(int startX, int startY, int width, int height, uint32_t color, bool fill, uint32_t fillColor);
 int fillScreen(uint32_t color);
\ No newline at end of file
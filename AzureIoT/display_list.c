@@ -0,0 +1,144 @@
+#include "display_list.h"
+
+#include <stdlib.h>
+
+#include "display.h"
+
+#define PIXEL_COUNT (DISPLAY_WIDTH * DISPLAY_HEIGHT)
+
+static uint16_t recordBuffer[PIXEL_COUNT]; /*!< Offscreen buffer screens are rendered into while recording. */
+
+/**
+* Count runs of identical pixels in the buffer.
+*/
+static size_t countRuns(const uint16_t* pixels)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < PIXEL_COUNT; i++)
+	{
+		if (i == 0 || pixels[i] != pixels[i - 1] || (i % 0xFFFF) == 0)
+			count++;
+	}
+	return count;
+}
+
+/**
+* Check whether display list holds a recorded screen.
+*
+* @param list Display list to check.
+* @return true if list can be replayed.
+*/
+bool isDisplayListRecorded(const struct displayList* list)
+{
+	return list->runs != NULL;
+}
+
+/**
+* Record a screen into display list.
+*
+* Screen is drawn into an offscreen buffer so the display and the framebuffer stay untouched,
+* then it is stored as runs of identical pixels. Static screens are mostly flat background so
+* they take a fraction of the framebuffer size. Requires framebuffer mode.
+*
+* @param list Display list to record into. Previously recorded screen is released.
+* @param draw Function drawing the whole screen using display primitives.
+* @param context Passed to draw.
+* @return 0 or -1 if something went wrong.
+*/
+int recordDisplayList(struct displayList* list, DisplayListDrawFunction draw, void* context)
+{
+	freeDisplayList(list);
+
+	if (setRenderTarget(recordBuffer) < 0)
+		return -1;
+
+	int result = draw(context);
+	setRenderTarget(NULL);
+	if (result < 0)
+		return -1;
+
+	size_t runCount = countRuns(recordBuffer);
+	struct displayListRun* runs = malloc(runCount * sizeof(struct displayListRun));
+	if (runs == NULL)
+		return -1;
+
+	size_t run = 0;
+	for (size_t i = 0; i < PIXEL_COUNT; i++)
+	{
+		if (i == 0 || recordBuffer[i] != recordBuffer[i - 1] || (i % 0xFFFF) == 0)
+		{
+			if (i != 0)
+				run++;
+			runs[run].length = 0;
+			runs[run].color = recordBuffer[i];
+		}
+		runs[run].length++;
+	}
+
+	list->runs = runs;
+	list->runCount = runCount;
+	return 0;
+}
+
+/**
+* Replay recorded screen into the framebuffer.
+*
+* Only pixels that actually change are marked dirty, so replaying a screen that differs from
+* the previous one in a few lines flushes just those lines.
+*
+* @param list Recorded display list.
+* @return 0 or -1 if list is not recorded.
+*/
+int replayDisplayList(const struct displayList* list)
+{
+	if (!isDisplayListRecorded(list))
+		return -1;
+
+	uint16_t* target = getRenderTarget();
+
+	int startX = DISPLAY_WIDTH;
+	int startY = DISPLAY_HEIGHT;
+	int endX = -1;
+	int endY = -1;
+
+	size_t pixel = 0;
+	for (size_t run = 0; run < list->runCount; run++)
+	{
+		uint16_t color = list->runs[run].color;
+		for (uint16_t i = 0; i < list->runs[run].length && pixel < PIXEL_COUNT; i++, pixel++)
+		{
+			if (target[pixel] == color)
+				continue;
+
+			target[pixel] = color;
+
+			int x = pixel % DISPLAY_WIDTH;
+			int y = pixel / DISPLAY_WIDTH;
+			if (x < startX)
+				startX = x;
+			if (x > endX)
+				endX = x;
+			if (y < startY)
+				startY = y;
+			if (y > endY)
+				endY = y;
+		}
+	}
+
+	if (endX >= 0)
+		invalidateRegion(startX, startY, endX, endY);
+
+	return 0;
+}
+
+/**
+* Release memory held by display list.
+*
+* @param list Display list to be released, can be recorded again afterwards.
+*/
+void freeDisplayList(struct displayList* list)
+{
+	free(list->runs);
+	list->runs = NULL;
+	list->runCount = 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+* Run of identical pixels in a recorded screen.
+*/
+struct displayListRun {
+	uint16_t length; /**< Number of pixels in the run. */
+	uint16_t color; /**< RGB565 color of the run. */
+};
+
+/**
+* Screen rendered once and stored as run length encoded pixels, row after row.
+*/
+struct displayList {
+	struct displayListRun *runs; /**< Recorded runs or NULL if list is not recorded yet. */
+	size_t runCount; /**< Number of runs. */
+};
+
+typedef int (*DisplayListDrawFunction)(void *context);
+
+bool isDisplayListRecorded(const struct displayList *list);
+int recordDisplayList(struct displayList *list, DisplayListDrawFunction draw, void *context);
+int replayDisplayList(const struct displayList *list);
+void freeDisplayList(struct displayList *list);
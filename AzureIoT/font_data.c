@@ -0,0 +1,134 @@
+/* Generated by script/fontgen.py from fonts/font10x11.h, do not edit. */
+#include "font_data.h"
+
+static const uint8_t font10x11Data[] = {
+	0xFF, 0xCF, 0xB6, 0x80, 0x28, 0xAF, 0xCA, 0x53, 0xF5, 0x14, 0x23, 0xB3, 0x8F, 0x3C, 0x73, 0x71,
+	0x00, 0x44, 0xA4, 0xA8, 0x48, 0x12, 0x15, 0x25, 0x22, 0x38, 0x6C, 0x6C, 0x38, 0x7A, 0xCE, 0xC6,
+	0x7B, 0xE0, 0x2D, 0x6D, 0xB2, 0x64, 0x99, 0x36, 0xDA, 0xD0, 0x25, 0x5C, 0xEA, 0x90, 0x21, 0x3E,
+	0x42, 0x00, 0xFE, 0xE0, 0xF0, 0x08, 0x44, 0x22, 0x10, 0x88, 0x44, 0x20, 0x76, 0xF7, 0xBD, 0xEF,
+	0x6E, 0x31, 0xCB, 0x0C, 0x30, 0xC3, 0x3F, 0x74, 0xC6, 0x33, 0x33, 0x1F, 0x74, 0xC6, 0xE1, 0x8E,
+	0x6E, 0x38, 0xE5, 0x96, 0x9B, 0xF1, 0x86, 0xFE, 0x31, 0xE1, 0x8C, 0x7E, 0x7E, 0x31, 0xED, 0xEF,
+	0x6E, 0xF8, 0xCC, 0x63, 0x31, 0x8C, 0x76, 0xF6, 0xED, 0xEF, 0x6E, 0x76, 0xF7, 0xB7, 0x8C, 0x7E,
+	0xF0, 0xF0, 0xF0, 0xFE, 0x1B, 0x20, 0xC1, 0x80, 0xF8, 0x3E, 0xC1, 0x82, 0x6C, 0x00, 0xF0, 0xC6,
+	0xE6, 0x01, 0x8C, 0x1F, 0x08, 0x24, 0xD6, 0x4D, 0xA2, 0x69, 0x99, 0xB9, 0x00, 0x3E, 0x00, 0x30,
+	0xC7, 0x92, 0xCF, 0xFC, 0xF3, 0xFB, 0x3C, 0xFE, 0xCF, 0x3C, 0xFE, 0x76, 0x71, 0x8C, 0x63, 0x2E,
+	0xF9, 0x9B, 0x1E, 0x3C, 0x78, 0xF3, 0x7C, 0xFE, 0x31, 0xFC, 0x63, 0x1F, 0xFE, 0x31, 0xFC, 0x63,
+	0x18, 0x7D, 0x87, 0x06, 0x0C, 0xF8, 0xF1, 0xBE, 0xC7, 0x8F, 0x1F, 0xFC, 0x78, 0xF1, 0xE3, 0xFF,
+	0xFF, 0x6D, 0xB6, 0xDE, 0xCF, 0x6D, 0xBC, 0xF3, 0x6D, 0xB3, 0xCC, 0xCC, 0xCC, 0xCF, 0xC1, 0xF1,
+	0xF8, 0xFE, 0xFD, 0x5E, 0xEF, 0x27, 0x93, 0xC7, 0xCF, 0x9E, 0xBD, 0x79, 0xF3, 0xE3, 0x7D, 0x8F,
+	0x1E, 0x3C, 0x78, 0xF1, 0xBE, 0xF6, 0xF7, 0xBF, 0x63, 0x18, 0x7C, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6,
+	0xC6, 0x7C, 0x03, 0xFB, 0x3C, 0xFE, 0xDB, 0x3C, 0xF3, 0x76, 0x71, 0xE7, 0x8E, 0x6E, 0xFC, 0xC3,
+	0x0C, 0x30, 0xC3, 0x0C, 0xC7, 0x8F, 0x1E, 0x3C, 0x78, 0xF1, 0xBE, 0xCF, 0x3C, 0xD2, 0x79, 0xE3,
+	0x0C, 0xCC, 0xF3, 0x36, 0xD9, 0xB6, 0x6D, 0x8C, 0xC3, 0x30, 0xCC, 0xCF, 0x37, 0x8C, 0x31, 0xEC,
+	0xF3, 0xCF, 0x37, 0x9E, 0x30, 0xC3, 0x0C, 0xF8, 0xCC, 0x66, 0x33, 0x1F, 0xFB, 0x6D, 0xB6, 0xDC,
+	0x84, 0x10, 0x82, 0x10, 0x82, 0x10, 0x42, 0xED, 0xB6, 0xDB, 0x7C, 0x22, 0x95, 0x10, 0xFC, 0x90,
+	0xF0, 0xDF, 0xBD, 0xBC, 0xC6, 0x3D, 0xBD, 0xEF, 0x7E, 0x7C, 0xCC, 0xC7, 0x18, 0xDF, 0xBD, 0xEF,
+	0x6F, 0x76, 0xFF, 0x8C, 0x3C, 0x7B, 0xED, 0xB6, 0x7F, 0x6D, 0x9C, 0xC1, 0xED, 0xBC, 0xC6, 0x3D,
+	0xBD, 0xEF, 0x7B, 0x04, 0x2C, 0xF3, 0xFF, 0xF8, 0xC6, 0x37, 0xBF, 0x7B, 0x7B, 0xFF, 0xFF, 0xF6,
+	0xDB, 0xDB, 0xDB, 0xDB, 0xDB, 0xF6, 0xF7, 0xBD, 0xEC, 0x76, 0xF7, 0xBD, 0xB8, 0xF6, 0xF7, 0xBD,
+	0xFB, 0x18, 0x7E, 0xF7, 0xBD, 0xBC, 0x63, 0xFB, 0x6D, 0x80, 0x7C, 0xE7, 0x3E, 0xDF, 0x6D, 0x98,
+	0xDE, 0xF7, 0xBD, 0xBC, 0xDE, 0xF6, 0xA7, 0x38, 0xDB, 0xDB, 0xDB, 0x66, 0x66, 0x66, 0xDE, 0xDC,
+	0xED, 0xEC, 0xDE, 0xF6, 0xA7, 0x19, 0x8C, 0xF3, 0x66, 0xCF, 0x7B, 0x69, 0xB6, 0xCC, 0x0A, 0xC6,
+	0x66, 0x36, 0x66, 0x6C, 0x6D, 0x80, 0xFE, 0x1B, 0x65, 0xB6, 0x98, 0x7F,
+};
+
+static const struct fontGlyph font10x11Glyphs[] = {
+	{ 0, 1, 2, 0, 0, FONT_ENCODING_PACKED }, // ' '
+	{ 0, 2, 3, 1, 8, FONT_ENCODING_PACKED }, // '!'
+	{ 2, 3, 4, 1, 3, FONT_ENCODING_PACKED }, // '"'
+	{ 4, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // '#'
+	{ 10, 5, 6, 0, 10, FONT_ENCODING_PACKED }, // '$'
+	{ 17, 8, 9, 1, 8, FONT_ENCODING_PACKED }, // '%'
+	{ 25, 8, 9, 1, 8, FONT_ENCODING_PACKED }, // '&'
+	{ 33, 1, 2, 1, 3, FONT_ENCODING_PACKED }, // "'"
+	{ 34, 3, 4, 1, 10, FONT_ENCODING_PACKED }, // '('
+	{ 38, 3, 4, 1, 10, FONT_ENCODING_PACKED }, // ')'
+	{ 42, 5, 6, 0, 6, FONT_ENCODING_PACKED }, // '*'
+	{ 46, 5, 6, 3, 5, FONT_ENCODING_PACKED }, // '+'
+	{ 50, 2, 3, 7, 4, FONT_ENCODING_PACKED }, // ','
+	{ 51, 3, 4, 5, 1, FONT_ENCODING_PACKED }, // '-'
+	{ 52, 2, 3, 7, 2, FONT_ENCODING_PACKED }, // '.'
+	{ 53, 5, 6, 0, 11, FONT_ENCODING_PACKED }, // '/'
+	{ 60, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '0'
+	{ 65, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // '1'
+	{ 71, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '2'
+	{ 76, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '3'
+	{ 81, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // '4'
+	{ 87, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '5'
+	{ 92, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '6'
+	{ 97, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '7'
+	{ 102, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '8'
+	{ 107, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '9'
+	{ 112, 2, 3, 3, 6, FONT_ENCODING_PACKED }, // ':'
+	{ 114, 2, 3, 3, 8, FONT_ENCODING_PACKED }, // ';'
+	{ 116, 5, 6, 3, 5, FONT_ENCODING_PACKED }, // '<'
+	{ 120, 5, 6, 4, 3, FONT_ENCODING_PACKED }, // '='
+	{ 122, 5, 6, 3, 5, FONT_ENCODING_PACKED }, // '>'
+	{ 126, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // '?'
+	{ 131, 10, 11, 1, 9, FONT_ENCODING_PACKED }, // '@'
+	{ 143, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'A'
+	{ 149, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'B'
+	{ 155, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'C'
+	{ 160, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'D'
+	{ 167, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'E'
+	{ 172, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'F'
+	{ 177, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'G'
+	{ 184, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'H'
+	{ 191, 2, 3, 1, 8, FONT_ENCODING_PACKED }, // 'I'
+	{ 193, 3, 4, 1, 8, FONT_ENCODING_PACKED }, // 'J'
+	{ 196, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'K'
+	{ 202, 4, 5, 1, 8, FONT_ENCODING_PACKED }, // 'L'
+	{ 206, 9, 10, 1, 8, FONT_ENCODING_PACKED }, // 'M'
+	{ 215, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'N'
+	{ 222, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'O'
+	{ 229, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'P'
+	{ 234, 8, 9, 1, 9, FONT_ENCODING_PACKED }, // 'Q'
+	{ 243, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'R'
+	{ 249, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'S'
+	{ 254, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'T'
+	{ 260, 7, 8, 1, 8, FONT_ENCODING_PACKED }, // 'U'
+	{ 267, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'V'
+	{ 273, 10, 11, 1, 8, FONT_ENCODING_PACKED }, // 'W'
+	{ 283, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'X'
+	{ 289, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // 'Y'
+	{ 295, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'Z'
+	{ 300, 3, 4, 1, 10, FONT_ENCODING_PACKED }, // '['
+	{ 304, 5, 6, 0, 11, FONT_ENCODING_PACKED }, // '\\'
+	{ 311, 3, 4, 1, 10, FONT_ENCODING_PACKED }, // ']'
+	{ 315, 5, 6, 1, 4, FONT_ENCODING_PACKED }, // '^'
+	{ 318, 6, 7, 10, 1, FONT_ENCODING_PACKED }, // '_'
+	{ 319, 2, 3, 0, 2, FONT_ENCODING_PACKED }, // '`'
+	{ 320, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'a'
+	{ 324, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'b'
+	{ 329, 4, 5, 3, 6, FONT_ENCODING_PACKED }, // 'c'
+	{ 332, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'd'
+	{ 337, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'e'
+	{ 341, 3, 4, 1, 8, FONT_ENCODING_PACKED }, // 'f'
+	{ 344, 6, 7, 3, 8, FONT_ENCODING_PACKED }, // 'g'
+	{ 350, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'h'
+	{ 355, 2, 3, 0, 9, FONT_ENCODING_RLE }, // 'i'
+	{ 357, 2, 3, 0, 11, FONT_ENCODING_PACKED }, // 'j'
+	{ 360, 5, 6, 1, 8, FONT_ENCODING_PACKED }, // 'k'
+	{ 365, 2, 3, 1, 8, FONT_ENCODING_PACKED }, // 'l'
+	{ 367, 8, 9, 3, 6, FONT_ENCODING_PACKED }, // 'm'
+	{ 373, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'n'
+	{ 377, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'o'
+	{ 381, 5, 6, 3, 8, FONT_ENCODING_PACKED }, // 'p'
+	{ 386, 5, 6, 3, 8, FONT_ENCODING_PACKED }, // 'q'
+	{ 391, 3, 4, 3, 6, FONT_ENCODING_PACKED }, // 'r'
+	{ 394, 4, 5, 3, 6, FONT_ENCODING_PACKED }, // 's'
+	{ 397, 3, 4, 2, 7, FONT_ENCODING_PACKED }, // 't'
+	{ 400, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'u'
+	{ 404, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'v'
+	{ 408, 8, 9, 3, 6, FONT_ENCODING_PACKED }, // 'w'
+	{ 414, 5, 6, 3, 6, FONT_ENCODING_PACKED }, // 'x'
+	{ 418, 5, 6, 3, 8, FONT_ENCODING_PACKED }, // 'y'
+	{ 423, 4, 5, 3, 6, FONT_ENCODING_PACKED }, // 'z'
+	{ 426, 3, 4, 1, 10, FONT_ENCODING_PACKED }, // '{'
+	{ 430, 1, 2, 1, 10, FONT_ENCODING_RLE }, // '|'
+	{ 431, 4, 5, 1, 10, FONT_ENCODING_PACKED }, // '}'
+	{ 436, 5, 6, 3, 2, FONT_ENCODING_PACKED }, // '~'
+	{ 438, 6, 7, 1, 8, FONT_ENCODING_PACKED }, // '\x7f'
+};
+
+const struct fontFace font10x11 = { 11, 3, 10, 0x20, 96, font10x11Glyphs, font10x11Data };
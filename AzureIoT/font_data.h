@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+
+/**
+* How pixels of a character are stored in the font data.
+*/
+enum fontEncoding {
+	FONT_ENCODING_PACKED, /**< One bit per pixel, row after row, most significant bit first. */
+	FONT_ENCODING_RLE /**< Nibbles of alternating runs starting with unset pixels, 15 means the run goes on in the next nibble. */
+};
+
+/**
+* Index entry of a single character.
+*
+* Only rows from top to top + rowCount contain ink and only these are stored, rows around them are empty.
+*/
+struct fontGlyph {
+	uint16_t offset; /**< Byte offset of the character in the font data. */
+	uint8_t width; /**< True width of the character in pixels, always at least 1. */
+	uint8_t advance; /**< Distance in pixels from this character to the next one. */
+	uint8_t top; /**< First stored row. */
+	uint8_t rowCount; /**< Number of stored rows, 0 for characters without ink. */
+	uint8_t encoding; /**< One of fontEncoding. */
+};
+
+/**
+* Compressed font generated by script/fontgen.py, lives in flash as it is never written.
+*/
+struct fontFace {
+	uint8_t height; /**< Height of every character in pixels. */
+	uint8_t topOffset; /**< Number of rows character reaches above its given position. */
+	uint8_t maxWidth; /**< Width of the widest character. */
+	uint8_t firstChar; /**< Character code of the first glyph. */
+	uint8_t glyphCount; /**< Number of entries in glyphs. */
+	const struct fontGlyph *glyphs; /**< Index of characters starting with firstChar. */
+	const uint8_t *data; /**< Encoded pixels of all characters. */
+};
+
+extern const struct fontFace font10x11;
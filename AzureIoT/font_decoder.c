@@ -0,0 +1,106 @@
+#include "font_decoder.h"
+
+#include <stddef.h>
+
+/**
+* Get next nibble of run lengths, high nibble of every byte goes first.
+*/
+static int readNibble(struct fontDecoder *decoder)
+{
+	uint8_t byte = decoder->face->data[decoder->glyph->offset + decoder->position / 2];
+	int nibble = (decoder->position & 1) ? byte & 0x0F : byte >> 4;
+	decoder->position++;
+	return nibble;
+}
+
+/**
+* Get next pixel of run length encoded character.
+*/
+static bool readRunPixel(struct fontDecoder *decoder)
+{
+	while (decoder->runRemaining == 0)
+	{
+		if (!decoder->runContinues)
+			decoder->runColor = !decoder->runColor;
+
+		int length = readNibble(decoder);
+		decoder->runRemaining = length;
+		decoder->runContinues = length == 15;
+	}
+
+	decoder->runRemaining--;
+	return decoder->runColor;
+}
+
+/**
+* Get next pixel of bit packed character.
+*/
+static bool readPackedPixel(struct fontDecoder *decoder)
+{
+	uint8_t byte = decoder->face->data[decoder->glyph->offset + decoder->position / 8];
+	bool set = (byte >> (7 - decoder->position % 8)) & 1;
+	decoder->position++;
+	return set;
+}
+
+/**
+* Look character up in the index of the font.
+*
+* @param face Font to search.
+* @param c Character to look up.
+* @return Index entry or NULL if the font doesn't contain the character.
+*/
+const struct fontGlyph *findFontGlyph(const struct fontFace *face, char c)
+{
+	int index = (uint8_t)c - face->firstChar;
+	if (index < 0 || index >= face->glyphCount)
+		return NULL;
+
+	return &face->glyphs[index];
+}
+
+/**
+* Prepare decoding of a character from its first row.
+*
+* @param decoder Decoder to be set up.
+* @param face Font the character belongs to.
+* @param glyph Character returned by findFontGlyph().
+*/
+void startFontDecoder(struct fontDecoder *decoder, const struct fontFace *face, const struct fontGlyph *glyph)
+{
+	decoder->face = face;
+	decoder->glyph = glyph;
+	decoder->position = 0;
+	decoder->row = 0;
+	decoder->runRemaining = 0;
+	decoder->runColor = true;//first run is of unset pixels, reading it flips the color
+	decoder->runContinues = false;
+}
+
+/**
+* Decode next row of the character.
+*
+* Rows have to be read from top to bottom, reading past the height of the font gives empty rows.
+*
+* @param decoder Decoder set up by startFontDecoder().
+* @return Bitmap of the row, bit n is column n.
+*/
+uint16_t decodeFontRow(struct fontDecoder *decoder)
+{
+	const struct fontGlyph *g = decoder->glyph;
+	int row = decoder->row;
+	if (row < decoder->face->height)
+		decoder->row++;
+
+	if (row < g->top || row >= g->top + g->rowCount)
+		return 0;
+
+	uint16_t bits = 0;
+	for (int column = 0; column < g->width; column++)
+	{
+		bool set = g->encoding == FONT_ENCODING_RLE ? readRunPixel(decoder) : readPackedPixel(decoder);
+		if (set)
+			bits |= 1 << column;
+	}
+	return bits;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "font_data.h"
+
+/**
+* Position within a character being decoded row by row, keeps nothing but a few counters so one
+* decoder per character of a line fits on the stack.
+*/
+struct fontDecoder {
+	const struct fontFace *face; /**< Font of the character. */
+	const struct fontGlyph *glyph; /**< Character being decoded. */
+	uint16_t position; /**< Next bit of packed data or next nibble of runs, relative to the character. */
+	uint8_t row; /**< Row returned by the next decodeFontRow() call. */
+	uint8_t runRemaining; /**< Pixels left in the current run. */
+	bool runColor; /**< True if the current run is of set pixels. */
+	bool runContinues; /**< True if the current run goes on in the next nibble. */
+};
+
+const struct fontGlyph *findFontGlyph(const struct fontFace *face, char c);
+void startFontDecoder(struct fontDecoder *decoder, const struct fontFace *face, const struct fontGlyph *glyph);
+uint16_t decodeFontRow(struct fontDecoder *decoder);
@@ -0,0 +1,189 @@
+#include "frame_scheduler.h"
+
+#include <time.h>
+
+#include "display.h"
+#include "epoll_timerfd_utilities.h"
+
+static int frameTimerFd = -1; /*!< Single expiry timer firing when next frame may be presented. */
+static FramePresentFunction presentFunction = NULL; /*!< Draws current state of the app and flushes it. */
+static long frameIntervalNs = 0; /*!< Minimum time between two presented frames. */
+static struct timespec lastPresentedAt = { 0, 0 }; /*!< When the last frame was presented. */
+static bool framePending = false; /*!< True if frame was requested and not presented yet. */
+static bool timerArmed = false; /*!< True if frameTimerFd is going to fire. */
+static bool awaitingRender = false; /*!< True if pending frame goes out once the render thread finished its frame. */
+static bool frameFailed = false; /*!< Set if presenting a frame failed, cleared by hasFrameFailed(). */
+
+/**
+* Get nanoseconds from a to b.
+*/
+static long long getElapsedNs(const struct timespec* a, const struct timespec* b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+/**
+* Arm the timer to fire after given time, zero or less fires as soon as possible.
+*/
+static int armFrameTimer(long long delayNs)
+{
+	if (delayNs < 1)
+		delayNs = 1;//zero would disarm the timer
+
+	struct timespec delay = { (time_t)(delayNs / 1000000000LL), (long)(delayNs % 1000000000LL) };
+	if (SetTimerFdToSingleExpiry(frameTimerFd, &delay) != 0)
+		return -1;
+
+	timerArmed = true;
+	return 0;
+}
+
+/**
+* Present pending frame right away.
+*/
+static int presentFrameNow()
+{
+	framePending = false;
+	clock_gettime(CLOCK_MONOTONIC, &lastPresentedAt);
+
+	if (presentFunction() < 0)
+	{
+		frameFailed = true;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+* Frame timer fired, present whatever state the app is in now.
+*/
+static void frameTimerEventHandler(EventData* eventData)
+{
+	if (ConsumeTimerFdEvent(frameTimerFd) != 0)
+	{
+		frameFailed = true;
+		return;
+	}
+
+	timerArmed = false;
+	if (!framePending)
+		return;
+
+	//panel is still busy with previous frame, anything requested meanwhile goes out as soon as it is done
+	if (isRenderBusy())
+	{
+		awaitingRender = true;
+		return;
+	}
+
+	presentFrameNow();
+}
+
+/**
+* Render thread finished a frame, present the frame that waited for it.
+*
+* Call after acknowledgeRenderCompletion(), a frame handed over by it keeps the pending frame waiting.
+*/
+void frameRenderCompleted()
+{
+	if (!awaitingRender || isRenderBusy())
+		return;
+
+	awaitingRender = false;
+	if (framePending)
+		presentFrameNow();
+}
+
+static EventData frameTimerEventData = { .eventHandler = &frameTimerEventHandler };
+
+/**
+* Set frame scheduler up.
+*
+* Requests made by requestFrame() are merged and presented from the event loop, at most framesPerSecond
+* times per second. States replaced before their frame is presented are never drawn.
+*
+* @param epollFd Epoll the frame timer is added to.
+* @param framesPerSecond Maximum number of presented frames per second.
+* @param present Draws current state of the app and flushes the display.
+* @return 0 or -1 if something went wrong.
+*/
+int initFrameScheduler(int epollFd, int framesPerSecond, FramePresentFunction present)
+{
+	if (setFrameRate(framesPerSecond) < 0)
+		return -1;
+
+	presentFunction = present;
+	framePending = false;
+	timerArmed = false;
+	awaitingRender = false;
+	frameFailed = false;
+	lastPresentedAt.tv_sec = 0;
+	lastPresentedAt.tv_nsec = 0;
+
+	const struct timespec disarmed = { 0, 0 };
+	frameTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &disarmed, &frameTimerEventData, EPOLLIN);
+	if (frameTimerFd < 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+* Close the frame timer, pending frame is dropped.
+*/
+void cleanupFrameScheduler()
+{
+	CloseFdAndPrintError(frameTimerFd, "Frame timer");
+	frameTimerFd = -1;
+	framePending = false;
+	timerArmed = false;
+	awaitingRender = false;
+}
+
+/**
+* Change maximum frame rate, takes effect from the next requested frame.
+*
+* @param framesPerSecond Maximum number of presented frames per second.
+* @return 0 or -1 if rate is not positive.
+*/
+int setFrameRate(int framesPerSecond)
+{
+	if (framesPerSecond <= 0)
+		return -1;
+
+	frameIntervalNs = 1000000000L / framesPerSecond;
+	return 0;
+}
+
+/**
+* Ask for current state of the app to be presented.
+*
+* Frame is presented from the event loop once the current tick is over and the frame interval since
+* the last frame passed, so any number of requests in between costs a single frame.
+*
+* @return 0 or -1 if something went wrong.
+*/
+int requestFrame()
+{
+	framePending = true;
+	if (timerArmed || awaitingRender)
+		return 0;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return armFrameTimer(frameIntervalNs - getElapsedNs(&lastPresentedAt, &now));
+}
+
+/**
+* Check whether presenting a frame from the event loop failed since the last check.
+*
+* @return true if a frame failed.
+*/
+bool hasFrameFailed()
+{
+	bool failed = frameFailed;
+	frameFailed = false;
+	return failed;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdbool.h>
+
+typedef int (*FramePresentFunction)(void);
+
+int initFrameScheduler(int epollFd, int framesPerSecond, FramePresentFunction present);
+void cleanupFrameScheduler();
+int setFrameRate(int framesPerSecond);
+
+int requestFrame();
+void frameRenderCompleted();
+bool hasFrameFailed();
@@ -0,0 +1,28 @@
+#include "glyph.h"
+
+#include <stddef.h>
+
+/**
+* Get character of the UI font.
+*
+* Index and pixels stay compressed in flash, see font_data.h, characters are decoded row by row while
+* they are drawn.
+*
+* @param c Character to look up. Should be between 32 and 127.
+* @return Index entry of the character or NULL if it is not in the font.
+*/
+const struct fontGlyph *getGlyph(char c)
+{
+	return findFontGlyph(&font10x11, c);
+}
+
+/**
+* Prepare decoding of a character returned by getGlyph() from its first row.
+*
+* @param decoder Decoder to be set up.
+* @param g Character returned by getGlyph().
+*/
+void startGlyphDecoder(struct fontDecoder *decoder, const struct fontGlyph *g)
+{
+	startFontDecoder(decoder, &font10x11, g);
+}
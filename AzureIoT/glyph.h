@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "font_decoder.h"
+
+#define GLYPH_MAX_WIDTH 10 /*!< Maximum width of a character in the font. */
+#define GLYPH_HEIGHT 11 /*!< Height of every character in the font. */
+#define GLYPH_TOP_OFFSET 3 /*!< Number of rows character reaches above its given position. */
+
+const struct fontGlyph *getGlyph(char c);
+void startGlyphDecoder(struct fontDecoder *decoder, const struct fontGlyph *g);
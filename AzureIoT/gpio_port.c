@@ -0,0 +1,251 @@
+#include "gpio_port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <applibs/gpio.h>
+
+#include "epoll_timerfd_utilities.h"
+
+#ifndef GPIO_CHIP
+#define GPIO_CHIP "/dev/gpiochip0" /*!< Character device of the chip pins are lines of. */
+#endif
+
+#if defined(__has_include) && __has_include(<linux/gpio.h>)
+#include <linux/gpio.h>
+#endif
+
+static int openApplibsPort(struct gpioPort *port, const int *pins, uint8_t initialValue)
+{
+	for (int i = 0; i < port->pinCount; i++)
+	{
+		if (port->flags & GPIO_PORT_OUTPUT)
+		{
+			GPIO_OutputMode_Type mode = (port->flags & GPIO_PORT_OPEN_DRAIN) ? GPIO_OutputMode_OpenDrain : GPIO_OutputMode_PushPull;
+			port->fds[i] = GPIO_OpenAsOutput(pins[i], mode, (initialValue & (1 << i)) ? GPIO_Value_High : GPIO_Value_Low);
+		}
+		else
+			port->fds[i] = GPIO_OpenAsInput(pins[i]);
+
+		if (port->fds[i] < 0)
+			return -1;
+	}
+	return 0;
+}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+static int openCdevPort(struct gpioPort *port, const int *pins, uint8_t initialValue)
+{
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof(request));
+	for (int i = 0; i < port->pinCount; i++)
+		request.offsets[i] = pins[i];
+	request.num_lines = port->pinCount;
+	strncpy(request.consumer, "lockbox", sizeof(request.consumer) - 1);
+
+	if (port->flags & GPIO_PORT_OUTPUT)
+	{
+		request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		if (port->flags & GPIO_PORT_OPEN_DRAIN)
+			request.config.flags |= GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+		request.config.num_attrs = 1;
+		request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		request.config.attrs[0].attr.values = initialValue;
+		request.config.attrs[0].mask = (1ULL << port->pinCount) - 1;
+	}
+	else
+	{
+		request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+		if (port->flags & GPIO_PORT_PULL_UP)
+			request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+		if (port->flags & GPIO_PORT_EDGE_EVENTS)
+			request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	}
+
+	int chipFd = open(GPIO_CHIP, O_RDONLY | O_CLOEXEC);
+	if (chipFd < 0)
+		return -1;
+
+	int result = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request);
+	close(chipFd);
+	if (result < 0)
+		return -1;
+
+	port->requestFd = request.fd;
+	//events are drained without waiting for more
+	if ((port->flags & GPIO_PORT_EDGE_EVENTS) && fcntl(port->requestFd, F_SETFL, O_NONBLOCK) < 0)
+		return -1;
+
+	return 0;
+}
+#else
+static int openCdevPort(struct gpioPort *port, const int *pins, uint8_t initialValue)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+/**
+* Open pins as one port.
+*
+* @param port Port to be set up.
+* @param driver How pins are reached, GPIO_DRIVER for the default one.
+* @param pins Numbers of the pins, pin n becomes bit n of port values.
+* @param pinCount Number of pins, at most GPIO_PORT_MAX_PINS.
+* @param flags GPIO_PORT_* flags.
+* @param initialValue Value of outputs right after opening, bit set for high.
+* @return 0 or -1 if something went wrong, nothing is left open then.
+*/
+int openGpioPort(struct gpioPort *port, enum gpioDriver driver, const int *pins, int pinCount, int flags, uint8_t initialValue)
+{
+	if (pinCount < 1 || pinCount > GPIO_PORT_MAX_PINS)
+		return -1;
+
+	port->driver = driver;
+	port->flags = flags;
+	port->pinCount = pinCount;
+	port->requestFd = -1;
+	port->outputValue = initialValue;
+	for (int i = 0; i < GPIO_PORT_MAX_PINS; i++)
+		port->fds[i] = -1;
+
+	int result = driver == GPIO_DRIVER_CDEV ? openCdevPort(port, pins, initialValue) : openApplibsPort(port, pins, initialValue);
+	if (result < 0)
+		closeGpioPort(port);
+
+	return result;
+}
+
+/**
+* Release pins of the port, closing a port that is zero initialized or already closed does nothing.
+*/
+void closeGpioPort(struct gpioPort *port)
+{
+	for (int i = 0; i < port->pinCount; i++)
+		CloseFdAndPrintError(port->fds[i], "GPIO");
+
+	if (port->driver == GPIO_DRIVER_CDEV)
+		CloseFdAndPrintError(port->requestFd, "GPIO lines");
+
+	port->pinCount = 0;
+	port->requestFd = -1;
+}
+
+/**
+* Set outputs of the port.
+*
+* Character device sets all pins in one ioctl, applibs writes only pins that differ from the last value.
+*
+* @param port Output port.
+* @param value Bit set for every pin to be high.
+* @return 0 or -1 if something went wrong.
+*/
+int writeGpioPort(struct gpioPort *port, uint8_t value)
+{
+	uint8_t all = (uint8_t)((1 << port->pinCount) - 1);
+	value &= all;
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	if (port->driver == GPIO_DRIVER_CDEV)
+	{
+		struct gpio_v2_line_values values = { value, all };
+		if (ioctl(port->requestFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+			return -1;
+
+		port->outputValue = value;
+		return 0;
+	}
+#endif
+
+	for (int i = 0; i < port->pinCount; i++)
+	{
+		uint8_t bit = 1 << i;
+		if ((value & bit) == (port->outputValue & bit))
+			continue;
+
+		if (GPIO_SetValue(port->fds[i], (value & bit) ? GPIO_Value_High : GPIO_Value_Low) < 0)
+			return -1;
+		port->outputValue ^= bit;
+	}
+	return 0;
+}
+
+/**
+* Read inputs of the port.
+*
+* Character device reads all pins in one ioctl, applibs reads only pins in mask.
+*
+* @param port Input port.
+* @param mask Pins that have to be read, bits of other pins may be left 0.
+* @param value Set to bit set for every pin that is high.
+* @return 0 or -1 if something went wrong.
+*/
+int readGpioPort(struct gpioPort *port, uint8_t mask, uint8_t *value)
+{
+	uint8_t all = (uint8_t)((1 << port->pinCount) - 1);
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	if (port->driver == GPIO_DRIVER_CDEV)
+	{
+		struct gpio_v2_line_values values = { 0, all };
+		if (ioctl(port->requestFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+			return -1;
+
+		*value = (uint8_t)(values.bits & all);
+		return 0;
+	}
+#endif
+
+	*value = 0;
+	for (int i = 0; i < port->pinCount; i++)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+
+		GPIO_Value_Type pinValue;
+		if (GPIO_GetValue(port->fds[i], &pinValue) < 0)
+			return -1;
+
+		if (pinValue == GPIO_Value_High)
+			*value |= 1 << i;
+	}
+	return 0;
+}
+
+/**
+* Get fd readable after any input of the port changed.
+*
+* @return File descriptor or -1 if port was opened without GPIO_PORT_EDGE_EVENTS or driver can't report changes.
+*/
+int getGpioPortEventFd(const struct gpioPort *port)
+{
+	if (port->driver != GPIO_DRIVER_CDEV || !(port->flags & GPIO_PORT_EDGE_EVENTS))
+		return -1;
+
+	return port->requestFd;
+}
+
+/**
+* Drop changes reported so far, event fd is not readable until the next one.
+*
+* @return 0 or -1 if something went wrong.
+*/
+int consumeGpioPortEvents(struct gpioPort *port)
+{
+	if (getGpioPortEventFd(port) < 0)
+		return 0;
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	struct gpio_v2_line_event events[16];
+	while (read(port->requestFd, events, sizeof(events)) > 0)
+		;
+
+	return errno == EAGAIN ? 0 : -1;
+#else
+	return 0;
+#endif
+}
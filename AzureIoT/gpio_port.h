@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+#define GPIO_PORT_MAX_PINS 8 /*!< Maximum number of pins in a port, bit n of a port value is pin n. */
+
+#define GPIO_PORT_OUTPUT 0x01 /*!< Pins are outputs, inputs otherwise. */
+#define GPIO_PORT_OPEN_DRAIN 0x02 /*!< Outputs only pull low. */
+#define GPIO_PORT_PULL_UP 0x04 /*!< Inputs are pulled up where the driver can do it. */
+#define GPIO_PORT_EDGE_EVENTS 0x08 /*!< Inputs report changes through getGpioPortEventFd() where the driver can do it. */
+
+#ifndef GPIO_DRIVER
+#define GPIO_DRIVER GPIO_DRIVER_APPLIBS /*!< Driver ports of the app are opened with. */
+#endif
+
+/**
+* How pins of a port are reached.
+*/
+enum gpioDriver {
+	GPIO_DRIVER_APPLIBS, /**< Applibs GPIO, one syscall per pin, written pins are cached so only changes are written. */
+	GPIO_DRIVER_CDEV /**< Linux GPIO character device, all pins of a port in one ioctl. */
+};
+
+/**
+* Pins read or written together as bits of one value.
+*/
+struct gpioPort {
+	enum gpioDriver driver; /**< Driver the port was opened with. */
+	int flags; /**< GPIO_PORT_* flags the port was opened with. */
+	int pinCount; /**< Number of pins. */
+	int fds[GPIO_PORT_MAX_PINS]; /**< Applibs file descriptor of every pin. */
+	int requestFd; /**< Character device line request holding all pins. */
+	uint8_t outputValue; /**< Last value written to outputs. */
+};
+
+int openGpioPort(struct gpioPort *port, enum gpioDriver driver, const int *pins, int pinCount, int flags, uint8_t initialValue);
+void closeGpioPort(struct gpioPort *port);
+
+int writeGpioPort(struct gpioPort *port, uint8_t value);
+int readGpioPort(struct gpioPort *port, uint8_t mask, uint8_t *value);
+int getGpioPortEventFd(const struct gpioPort *port);
+int consumeGpioPortEvents(struct gpioPort *port);
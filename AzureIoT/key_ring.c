@@ -0,0 +1,64 @@
+#include "key_ring.h"
+
+_Static_assert((KEY_RING_SIZE & (KEY_RING_SIZE - 1)) == 0, "KEY_RING_SIZE has to be a power of two");
+
+/**
+* Empty the ring, neither thread may use it meanwhile.
+*/
+void initKeyRing(struct keyRing *ring)
+{
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->dropped, 0);
+}
+
+/**
+* Add event to the ring, called only by the producer.
+*
+* @param ring Ring to add to.
+* @param event Event to be copied into the ring.
+* @return false if the ring is full, event is counted as dropped then.
+*/
+bool pushKeyEvent(struct keyRing *ring, const struct keyEvent *event)
+{
+	unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail == KEY_RING_SIZE)
+	{
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+
+	ring->events[head & (KEY_RING_SIZE - 1)] = *event;
+	//event has to be written before consumer can see the new head
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return true;
+}
+
+/**
+* Take the oldest event from the ring, called only by the consumer.
+*
+* @param ring Ring to take from.
+* @param event Set to the oldest event.
+* @return false if the ring is empty.
+*/
+bool popKeyEvent(struct keyRing *ring, struct keyEvent *event)
+{
+	unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	*event = ring->events[tail & (KEY_RING_SIZE - 1)];
+	//slot may be reused by producer only after it was copied out
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+/**
+* Get number of events dropped because the consumer didn't keep up.
+*/
+unsigned getDroppedKeyEvents(struct keyRing *ring)
+{
+	return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
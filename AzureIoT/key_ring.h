@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#ifndef KEY_RING_SIZE
+#define KEY_RING_SIZE 32 /*!< Number of key events the ring holds, has to be a power of two. */
+#endif
+
+/**
+* Debounced press of a key.
+*/
+struct keyEvent {
+	char key; /**< Pressed key. */
+	struct timespec pressedAt; /**< CLOCK_MONOTONIC time the key was first seen down. */
+};
+
+/**
+* Bounded ring of key events between a single producer and a single consumer thread.
+*
+* Neither side ever waits for the other one. Producer only writes head, consumer only writes tail,
+* both indexes run freely and are masked when used.
+*/
+struct keyRing {
+	struct keyEvent events[KEY_RING_SIZE]; /**< Storage of the events. */
+	atomic_uint head; /**< Number of events ever pushed. */
+	atomic_uint tail; /**< Number of events ever popped. */
+	atomic_uint dropped; /**< Number of events not pushed because the ring was full. */
+};
+
+void initKeyRing(struct keyRing *ring);
+bool pushKeyEvent(struct keyRing *ring, const struct keyEvent *event);
+bool popKeyEvent(struct keyRing *ring, struct keyEvent *event);
+unsigned getDroppedKeyEvents(struct keyRing *ring);
@@ -1,8 +1,37 @@
 #include "keyboard.h"
 
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
 #include <applibs/log.h>
-#include <applibs/gpio.h>
 #include "epoll_timerfd_utilities.h"
+#include "key_ring.h"
+#include "keypad_backend.h"
+
+#ifndef KEYPAD_BACKEND
+#define KEYPAD_BACKEND applibsKeypadBackend /*!< Backend used unless setKeypadBackend() picks another one. */
+#endif
+
+#ifndef KEYPAD_FAST_SCAN_MS
+#define KEYPAD_FAST_SCAN_MS 2 /*!< Scan period while a key is down or was just released. */
+#endif
+
+#ifndef KEYPAD_SLOW_SCAN_MS
+#define KEYPAD_SLOW_SCAN_MS 32 /*!< Scan period backing off stops at. */
+#endif
+
+#ifndef KEYPAD_IDLE_CHECK_MS
+#define KEYPAD_IDLE_CHECK_MS 64 /*!< Period idle rows are checked with by backends without row events, delays only the first key of a burst. */
+#endif
+
+#define COLUMN_COUNT 4
+#define ROW_COUNT 4
+#define KEY_COUNT (COLUMN_COUNT * ROW_COUNT)
 
 const int columnPins[4] = { 26, 28, 2, 1 };
 const int rowPins[4] = { 43, 17, 38, 37 };
@@ -14,82 +43,455 @@ const signed char matrix[4][4] = {
 	{'*', '0', '#', 'D'},
 };
 
-int columnPinsFds[4];
-int rowPinsFds[4];
+/**
+* Debounced state of a single key.
+*/
+enum keyState {
+	KEY_UP, /**< Released and stable. */
+	KEY_PRESSING, /**< Seen down, waiting for press time to pass. */
+	KEY_DOWN, /**< Pressed and stable, press was reported. */
+	KEY_RELEASING /**< Seen up, waiting for release time to pass. */
+};
 
-int initKeyboard()
+/**
+* Debounce state machine of a key.
+*/
+struct keyDebounce {
+	enum keyState state; /**< Current state. */
+	struct timespec since; /**< Time the key entered pressing or releasing state. */
+};
+
+static const struct keypadBackend *backend = &KEYPAD_BACKEND; /*!< Pins of the keypad. */
+static int keypadEpollFd = -1; /*!< Epoll of the keypad thread. */
+static int stopEventFd = -1; /*!< Written to make the keypad thread exit. */
+static int keyEventFd = -1; /*!< Written after every pushed key, readable on the app epoll. */
+static pthread_t keypadThread; /*!< Thread scanning the keypad. */
+static bool keypadThreadRunning = false; /*!< True between starting and joining keypadThread. */
+static bool keypadStop = false; /*!< Set on the keypad thread to leave its loop. */
+static int rowEventFd = -1; /*!< Readable after a row changed, -1 if backend can't tell. */
+static int scanTimerFd = -1; /*!< Single expiry timer of the next scan. */
+static bool idle = false; /*!< True while all columns are held low waiting for a key. */
+static int scanPeriodMs = KEYPAD_FAST_SCAN_MS; /*!< Time to the next scan while not idle. */
+static int pressMs = 6; /*!< Time a key has to stay down to be pressed. */
+static int releaseMs = 10; /*!< Time a key has to stay up to be released. */
+static struct keyDebounce keys[KEY_COUNT]; /*!< Keys indexed by row * COLUMN_COUNT + column. */
+static struct keyRing keyRing; /*!< Pressed keys on their way from the keypad thread to the app. */
+static atomic_bool keypadFailed; /*!< Set if scanning failed on the keypad thread, reported by takeKeyEvent(). */
+
+/**
+* Get milliseconds from a to b.
+*/
+static long getElapsedMs(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000L + (b->tv_nsec - a->tv_nsec) / 1000000L;
+}
+
+static int armScanTimer(int ms)
+{
+	const struct timespec delay = { ms / 1000, (ms % 1000) * 1000000L };
+	return SetTimerFdToSingleExpiry(scanTimerFd, &delay);
+}
+
+/**
+* Read every column.
+*
+* All columns are selected and all rows read first, only rows found low there can be low with a single
+* column selected, so the matrix is walked column by column only while some key is down and then reads
+* just those rows.
+*
+* @param rows Array of COLUMN_COUNT entries set to rows reading low with the column selected.
+* @return 0 or -1 if something went wrong.
+*/
+static int scanMatrix(uint8_t *rows)
 {
-	for (int i = 0; i < 4; i++)
+	uint8_t activeRows;
+	if (backend->selectColumns((1 << COLUMN_COUNT) - 1) < 0 || backend->readRows((1 << ROW_COUNT) - 1, &activeRows) < 0)
+		return -1;
+
+	for (int i = 0; i < COLUMN_COUNT; i++)
 	{
-		columnPinsFds[i] = GPIO_OpenAsOutput(columnPins[i], GPIO_OutputMode_PushPull, GPIO_Value_High);
-		if (columnPinsFds[i] < 0)
+		rows[i] = 0;
+		if (activeRows != 0 && (backend->selectColumns(1 << i) < 0 || backend->readRows(activeRows, &rows[i]) < 0))
 			return -1;
 	}
-	for (int i = 0; i < 4; i++)
+	return 0;
+}
+
+/**
+* Find keys whose reading can't be trusted.
+*
+* Without diodes three keys held in corners of a rectangle pull the fourth corner low too, so
+* when two columns share two or more rows nobody can tell which of those keys are really down.
+*
+* @param rows Reading of every column.
+* @param ambiguous Array of COLUMN_COUNT entries set to rows of the column that may be ghosts.
+*/
+static void findGhosts(const uint8_t *rows, uint8_t *ambiguous)
+{
+	for (int i = 0; i < COLUMN_COUNT; i++)
+		ambiguous[i] = 0;
+
+	for (int i = 0; i < COLUMN_COUNT; i++)
 	{
-		rowPinsFds[i] = GPIO_OpenAsInput(rowPins[i]);
-		if (rowPinsFds[i] < 0)
-			return -1;
+		for (int j = i + 1; j < COLUMN_COUNT; j++)
+		{
+			uint8_t shared = rows[i] & rows[j];
+			if (shared & (shared - 1))//more than one bit
+			{
+				ambiguous[i] |= shared;
+				ambiguous[j] |= shared;
+			}
+		}
 	}
-	return 0;
 }
 
-int cleanupKeyboard()
+/**
+* Move key through its debounce states.
+*
+* @return true if key just became pressed.
+*/
+static bool debounceKey(struct keyDebounce *key, bool down, const struct timespec *now)
 {
-	for (int i = 0; i < 4; i++)
+	switch (key->state)
 	{
-		CloseFdAndPrintError(columnPinsFds[i], "Mode pin");
+	case KEY_UP:
+		if (!down)
+			return false;
+		key->state = KEY_PRESSING;
+		key->since = *now;
+		//fall through, zero press time presses right away
+	case KEY_PRESSING:
+		if (!down)
+			key->state = KEY_UP;
+		else if (getElapsedMs(&key->since, now) >= pressMs)
+		{
+			key->state = KEY_DOWN;
+			return true;
+		}
+		return false;
+	case KEY_DOWN:
+		if (down)
+			return false;
+		key->state = KEY_RELEASING;
+		key->since = *now;
+		//fall through
+	case KEY_RELEASING:
+		if (down)
+			key->state = KEY_DOWN;
+		else if (getElapsedMs(&key->since, now) >= releaseMs)
+			key->state = KEY_UP;
+		return false;
 	}
-	for (int i = 0; i < 4; i++)
+	return false;
+}
+
+static int enterIdle();
+
+/**
+* Scan the matrix, debounce every key and schedule the next scan.
+*
+* Scans come every KEYPAD_FAST_SCAN_MS while any key is not released and stable, afterwards the
+* period doubles with every quiet scan until it reaches KEYPAD_SLOW_SCAN_MS and the keypad goes idle.
+*
+* @return 0 or -1 if something went wrong.
+*/
+static int runScan()
+{
+	uint8_t rows[COLUMN_COUNT];
+	uint8_t ambiguous[COLUMN_COUNT];
+	if (scanMatrix(rows) < 0)
+		return -1;
+
+	findGhosts(rows, ambiguous);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	bool active = false;
+	for (int row = 0; row < ROW_COUNT; row++)
 	{
-		CloseFdAndPrintError(rowPinsFds[i], "Mode pin");
+		for (int column = 0; column < COLUMN_COUNT; column++)
+		{
+			struct keyDebounce *key = &keys[row * COLUMN_COUNT + column];
+			uint8_t bit = 1 << row;
+
+			//ghost candidates keep their state until the reading is unambiguous again
+			if (!(ambiguous[column] & bit) && debounceKey(key, (rows[column] & bit) != 0, &now))
+			{
+				//full ring means app is stuck for long, dropped presses are counted by the ring
+				const struct keyEvent event = { matrix[row][column], key->since };
+				const uint64_t one = 1;
+				if (pushKeyEvent(&keyRing, &event) && write(keyEventFd, &one, sizeof(one)) != sizeof(one))
+					return -1;
+			}
+
+			if (key->state != KEY_UP)
+				active = true;
+		}
 	}
 
-	return 0;
+	if (active)
+		scanPeriodMs = KEYPAD_FAST_SCAN_MS;
+	else if (scanPeriodMs * 2 > KEYPAD_SLOW_SCAN_MS)
+		return enterIdle();
+	else
+		scanPeriodMs *= 2;
+
+	return armScanTimer(scanPeriodMs);
+}
+
+/**
+* Leave idle and scan right away.
+*/
+static int startScanning()
+{
+	idle = false;
+	scanPeriodMs = KEYPAD_FAST_SCAN_MS;
+	return runScan();
 }
 
 /**
-* Wait given amount of microseconds
+* Stop scanning and hold every column low, so any key pulls its row low.
 *
-* @param us Number of microseconds to wait.
+* With row events nothing runs until a row changes, otherwise rows are checked every KEYPAD_IDLE_CHECK_MS.
+* The applibs backend has no row events, so there the keypad thread keeps waking up that often while idle.
+*
+* @return 0 or -1 if something went wrong.
 */
-static void wait(int us)
+static int enterIdle()
 {
-	const struct timespec sleepTime = { 0, 1000 * us };
-	nanosleep(&sleepTime, NULL);
+	if (backend->selectColumns((1 << COLUMN_COUNT) - 1) < 0)
+		return -1;
+
+	//edges caused by scanning are stale, key held down right now is seen below
+	if (backend->consumeEvents() < 0)
+		return -1;
+
+	uint8_t rows;
+	if (backend->readRows((1 << ROW_COUNT) - 1, &rows) < 0)
+		return -1;
+
+	if (rows != 0)
+		return startScanning();
+
+	idle = true;
+	if (rowEventFd >= 0)
+		return 0;
+
+	return armScanTimer(KEYPAD_IDLE_CHECK_MS);
 }
 
-int checkForKeyPress(char *c)
+/**
+* Time for the next scan or idle check.
+*/
+static void scanTimerEventHandler(EventData *eventData)
 {
+	if (ConsumeTimerFdEvent(scanTimerFd) != 0)
+	{
+		atomic_store(&keypadFailed, true);
+		return;
+	}
 
-	for (int i = 0; i < 4; i++)
+	int result;
+	if (!idle)
+		result = runScan();
+	else
 	{
-		int result = GPIO_SetValue(columnPinsFds[i], GPIO_Value_Low);
-		if (result < 0)
-			return -1;
-		for (int j = 0; j < 4; j++)
-		{
-			  GPIO_Value_Type val;
-			int result = GPIO_GetValue(rowPinsFds[j], &val);
-			if (result < 0)
-				return -1;
+		uint8_t rows;
+		result = backend->readRows((1 << ROW_COUNT) - 1, &rows);
+		if (result == 0)
+			result = rows != 0 ? startScanning() : armScanTimer(KEYPAD_IDLE_CHECK_MS);
+	}
 
-			if (val == GPIO_Value_Low)
-			{
-				//Log_Debug("%d, %d\n", i, j);
+	if (result < 0)
+		atomic_store(&keypadFailed, true);
+}
 
-				result = GPIO_SetValue(columnPinsFds[i], GPIO_Value_High);
-				if (result < 0)
-					return -1;
+/**
+* Row changed, start scanning if the keypad was idle.
+*/
+static void rowEventHandler(EventData *eventData)
+{
+	if (backend->consumeEvents() < 0 || (idle && startScanning() < 0))
+		atomic_store(&keypadFailed, true);
+}
 
-				*c = matrix[j][i];
-				return 0;
-			}
-				
+/**
+* Cleanup asked the keypad thread to exit.
+*/
+static void stopEventHandler(EventData *eventData)
+{
+	keypadStop = true;
+}
+
+static EventData scanTimerEventData = { .eventHandler = &scanTimerEventHandler };
+static EventData rowEventData = { .eventHandler = &rowEventHandler };
+static EventData stopEventData = { .eventHandler = &stopEventHandler };
+
+/**
+* Keypad thread, samples the keypad no matter what the app loop is busy with.
+*/
+static void *keypadThreadMain(void *arg)
+{
+	while (!keypadStop)
+	{
+		if (WaitForEventAndCallHandler(keypadEpollFd) != 0)
+		{
+			atomic_store(&keypadFailed, true);
+			break;
 		}
-		result = GPIO_SetValue(columnPinsFds[i], GPIO_Value_High);
-		if (result < 0)
-			return -1;
 	}
+	return NULL;
+}
+
+/**
+* Choose pins the keypad is accessed through, has to be called before initKeyboard().
+*
+* @param keypad One of the backends from keypad_backend.h.
+*/
+void setKeypadBackend(const struct keypadBackend *keypad)
+{
+	backend = keypad;
+}
+
+/**
+* Set how long a key has to stay down to be pressed and up to be released, has to be called before initKeyboard().
+*
+* @param press Press time in milliseconds.
+* @param release Release time in milliseconds.
+* @return 0 or -1 if a time is negative.
+*/
+int setKeypadDebounce(int press, int release)
+{
+	if (press < 0 || release < 0)
+		return -1;
+
+	pressMs = press;
+	releaseMs = release;
 	return 0;
-}
\ No newline at end of file
+}
+
+/**
+* Open keypad pins and start sampling them on the keypad thread.
+*
+* Pressed keys go through a lock-free ring and are taken with takeKeyEvent(), so keys typed while
+* the app loop is blocked are kept until it gets to them.
+*
+* @return 0 or -1 if something went wrong.
+*/
+int initKeyboard()
+{
+	if (backend->open(columnPins, COLUMN_COUNT, rowPins, ROW_COUNT) < 0)
+	{
+		Log_Debug("ERROR: Could not open %s keypad.\n", backend->name);
+		return -1;
+	}
+
+	for (int i = 0; i < KEY_COUNT; i++)
+		keys[i].state = KEY_UP;
+	initKeyRing(&keyRing);
+	atomic_store(&keypadFailed, false);
+	keypadStop = false;
+
+	keypadEpollFd = CreateEpollFd();
+	if (keypadEpollFd < 0)
+		return -1;
+
+	const struct timespec disarmed = { 0, 0 };
+	scanTimerFd = CreateTimerFdAndAddToEpoll(keypadEpollFd, &disarmed, &scanTimerEventData, EPOLLIN);
+	if (scanTimerFd < 0)
+		return -1;
+
+	stopEventFd = eventfd(0, EFD_CLOEXEC);
+	if (stopEventFd < 0 || RegisterEventHandlerToEpoll(keypadEpollFd, stopEventFd, &stopEventData, EPOLLIN) < 0)
+		return -1;
+
+	keyEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (keyEventFd < 0)
+		return -1;
+
+	rowEventFd = backend->getEventFd();
+	if (rowEventFd >= 0 && RegisterEventHandlerToEpoll(keypadEpollFd, rowEventFd, &rowEventData, EPOLLIN) < 0)
+		return -1;
+
+	//thread owns the pins from now on
+	if (enterIdle() < 0)
+		return -1;
+
+	if (pthread_create(&keypadThread, NULL, keypadThreadMain, NULL) != 0)
+		return -1;
+
+	keypadThreadRunning = true;
+	return 0;
+}
+
+int cleanupKeyboard()
+{
+	if (keypadThreadRunning)
+	{
+		const uint64_t stop = 1;
+		if (write(stopEventFd, &stop, sizeof(stop)) == sizeof(stop))
+			pthread_join(keypadThread, NULL);
+		keypadThreadRunning = false;
+	}
+
+	CloseFdAndPrintError(stopEventFd, "Keypad stop event");
+	CloseFdAndPrintError(keyEventFd, "Key event");
+	CloseFdAndPrintError(scanTimerFd, "Keypad timer");
+	CloseFdAndPrintError(keypadEpollFd, "Keypad epoll");
+	backend->close();
+	stopEventFd = -1;
+	keyEventFd = -1;
+	scanTimerFd = -1;
+	keypadEpollFd = -1;
+	rowEventFd = -1;
+	return 0;
+}
+
+/**
+* Take the oldest pressed key.
+*
+* Every debounced press is reported once, keys held down together are reported in the order they were pressed.
+*
+* @param event Set to the oldest pressed key.
+* @return 1 if event was taken, 0 if no key was pressed or -1 if scanning failed.
+*/
+int takeKeyEvent(struct keyEvent *event)
+{
+	if (atomic_load(&keypadFailed))
+		return -1;
+
+	return popKeyEvent(&keyRing, event) ? 1 : 0;
+}
+
+/**
+* Get fd readable after a key was pressed, register it in the app epoll so keys are taken as they come.
+*
+* @return File descriptor or -1 if keyboard is not initialized.
+*/
+int getKeyEventFd()
+{
+	return keyEventFd;
+}
+
+/**
+* Make key event fd not readable until the next press, take the keys with takeKeyEvent() afterwards.
+*
+* @return 0 or -1 if something went wrong.
+*/
+int consumeKeyEvents()
+{
+	uint64_t count;
+	if (read(keyEventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -1;
+
+	return 0;
+}
+
+/**
+* Get number of presses lost because the app didn't take keys before the ring filled up.
+*
+* @return Presses dropped since the keyboard was initialized.
+*/
+unsigned getDroppedKeyCount()
+{
+	return getDroppedKeyEvents(&keyRing);
+}
@@ -1,6 +1,14 @@
 #pragma once
 
+struct keypadBackend;
+struct keyEvent;
+
+void setKeypadBackend(const struct keypadBackend *keypad);
+int setKeypadDebounce(int pressMs, int releaseMs);
 int initKeyboard();
 int cleanupKeyboard();
 
-int checkForKeyPress(char* c);
\ No newline at end of file
+int takeKeyEvent(struct keyEvent* event);
+int getKeyEventFd();
+int consumeKeyEvents();
+unsigned getDroppedKeyCount();
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+#define KEYPAD_MAX_LINES 8 /*!< Maximum number of columns or rows of a keypad. */
+
+/**
+* Access to the pins of a keypad matrix.
+*
+* Columns are outputs, a selected column is driven low and the others high. Rows are inputs,
+* a row reads low while a key connects it to a selected column.
+*/
+struct keypadBackend {
+	const char *name; /**< Name of the backend used in logs. */
+	int (*open)(const int *columnPins, int columnCount, const int *rowPins, int rowCount); /**< Claim the pins with no column selected, returns 0 or -1. */
+	void (*close)(); /**< Release the pins. */
+	int (*selectColumns)(uint8_t columns); /**< Select columns whose bits are set, returns 0 or -1. */
+	int (*readRows)(uint8_t mask, uint8_t *rows); /**< Set bit of every row in mask that reads low, returns 0 or -1. */
+	int (*getEventFd)(); /**< Get fd readable after any row changed or -1 if backend can't report changes. */
+	int (*consumeEvents)(); /**< Make event fd not readable until next change, returns 0 or -1. */
+};
+
+extern const struct keypadBackend applibsKeypadBackend;
+extern const struct keypadBackend cdevKeypadBackend;
+extern const struct keypadBackend mockKeypadBackend;
@@ -0,0 +1,94 @@
+#include "keypad_backend.h"
+
+#include "gpio_port.h"
+
+static struct gpioPort columnPort; /*!< Column outputs, a low bit selects the column. */
+static struct gpioPort rowPort; /*!< Row inputs, a low bit means a key pulls the row down. */
+
+/**
+* Open columns high so nothing is selected and rows pulled up.
+*/
+static int openKeypadPorts(enum gpioDriver driver, const int *columnPins, int columnCount, const int *rowPins, int rowCount)
+{
+	if (columnCount > KEYPAD_MAX_LINES || rowCount > KEYPAD_MAX_LINES)
+		return -1;
+
+	if (openGpioPort(&columnPort, driver, columnPins, columnCount, GPIO_PORT_OUTPUT, 0xFF) < 0)
+		return -1;
+
+	if (openGpioPort(&rowPort, driver, rowPins, rowCount, GPIO_PORT_PULL_UP | GPIO_PORT_EDGE_EVENTS, 0) < 0)
+	{
+		closeGpioPort(&columnPort);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int openApplibsKeypad(const int *columnPins, int columnCount, const int *rowPins, int rowCount)
+{
+	return openKeypadPorts(GPIO_DRIVER_APPLIBS, columnPins, columnCount, rowPins, rowCount);
+}
+
+static int openCdevKeypad(const int *columnPins, int columnCount, const int *rowPins, int rowCount)
+{
+	return openKeypadPorts(GPIO_DRIVER_CDEV, columnPins, columnCount, rowPins, rowCount);
+}
+
+static void closeKeypadPorts()
+{
+	closeGpioPort(&columnPort);
+	closeGpioPort(&rowPort);
+}
+
+static int selectKeypadColumns(uint8_t columns)
+{
+	return writeGpioPort(&columnPort, (uint8_t)~columns);
+}
+
+static int readKeypadRows(uint8_t mask, uint8_t *rows)
+{
+	uint8_t value;
+	if (readGpioPort(&rowPort, mask, &value) < 0)
+		return -1;
+
+	*rows = (uint8_t)~value & mask;
+	return 0;
+}
+
+static int getKeypadEventFd()
+{
+	return getGpioPortEventFd(&rowPort);
+}
+
+static int consumeKeypadEvents()
+{
+	return consumeGpioPortEvents(&rowPort);
+}
+
+/**
+* Applibs has no edge events so rows are polled, each pin costs a syscall but unchanged columns
+* and rows outside the mask are skipped.
+*/
+const struct keypadBackend applibsKeypadBackend = {
+	"applibs",
+	openApplibsKeypad,
+	closeKeypadPorts,
+	selectKeypadColumns,
+	readKeypadRows,
+	getKeypadEventFd,
+	consumeKeypadEvents
+};
+
+/**
+* Character device drives all columns or reads all rows in a single ioctl and wakes on row edges.
+*/
+const struct keypadBackend cdevKeypadBackend = {
+	"gpio-cdev",
+	openCdevKeypad,
+	closeKeypadPorts,
+	selectKeypadColumns,
+	readKeypadRows,
+	getKeypadEventFd,
+	consumeKeypadEvents
+};
@@ -0,0 +1,146 @@
+#include "keypad_mock.h"
+#include "keypad_backend.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "epoll_timerfd_utilities.h"
+
+static uint8_t heldKeys[KEYPAD_MAX_LINES]; /*!< Bit n of entry r is set while key in row r and column n is held. */
+static uint8_t selectedColumns = 0; /*!< Columns currently driven low. */
+static int rowCount = 0; /*!< Number of rows of the keypad. */
+static int eventFd = -1; /*!< Signaled whenever a row changes. */
+static long accesses = 0; /*!< Number of selectColumns and readRows calls, each stands for pin syscalls on hardware. */
+
+/**
+* Get rows reading low with given columns selected.
+*
+* Like a matrix without diodes held keys connect rows and columns into paths, so a row also reads low
+* when it reaches a selected column through other held keys.
+*/
+static uint8_t getLowRows(uint8_t columns)
+{
+	uint8_t rows = 0;
+	uint8_t reached;
+	do
+	{
+		reached = rows;
+		for (int i = 0; i < rowCount; i++)
+		{
+			if (heldKeys[i] & columns)
+				rows |= 1 << i;
+		}
+		for (int i = 0; i < rowCount; i++)
+		{
+			if (rows & (1 << i))
+				columns |= heldKeys[i];
+		}
+	} while (rows != reached);
+
+	return rows;
+}
+
+/**
+* Report row change like an edge event of a real GPIO would.
+*/
+static void signalRowChange(uint8_t before)
+{
+	if (getLowRows(selectedColumns) == before)
+		return;
+
+	uint64_t one = 1;
+	if (write(eventFd, &one, sizeof(one)) < 0)
+		return;
+}
+
+static int openMockKeypad(const int *columnPins, int columnCount, const int *rowPins, int rows)
+{
+	if (columnCount > KEYPAD_MAX_LINES || rows > KEYPAD_MAX_LINES)
+		return -1;
+
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd < 0)
+		return -1;
+
+	rowCount = rows;
+	selectedColumns = 0;
+	accesses = 0;
+	return 0;
+}
+
+static void closeMockKeypad()
+{
+	CloseFdAndPrintError(eventFd, "Mock keypad");
+	eventFd = -1;
+}
+
+static int selectMockColumns(uint8_t columns)
+{
+	uint8_t before = getLowRows(selectedColumns);
+	selectedColumns = columns;
+	accesses++;
+	signalRowChange(before);
+	return 0;
+}
+
+static int readMockRows(uint8_t mask, uint8_t *rows)
+{
+	*rows = getLowRows(selectedColumns) & mask;
+	accesses++;
+	return 0;
+}
+
+static int getMockEventFd()
+{
+	return eventFd;
+}
+
+static int consumeMockEvents()
+{
+	uint64_t count;
+	if (read(eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -1;
+
+	return 0;
+}
+
+/**
+* Press or release a key of the mock keypad.
+*
+* @param row Row of the key.
+* @param column Column of the key.
+* @param pressed True to hold the key down, false to release it.
+*/
+void setMockKey(int row, int column, bool pressed)
+{
+	if (row < 0 || row >= KEYPAD_MAX_LINES || column < 0 || column >= KEYPAD_MAX_LINES)
+		return;
+
+	uint8_t before = getLowRows(selectedColumns);
+	if (pressed)
+		heldKeys[row] |= 1 << column;
+	else
+		heldKeys[row] &= ~(1 << column);
+
+	if (eventFd >= 0)
+		signalRowChange(before);
+}
+
+/**
+* Get number of pin accesses since the mock keypad was opened.
+*/
+long getMockKeypadAccesses()
+{
+	return accesses;
+}
+
+const struct keypadBackend mockKeypadBackend = {
+	"mock",
+	openMockKeypad,
+	closeMockKeypad,
+	selectMockColumns,
+	readMockRows,
+	getMockEventFd,
+	consumeMockEvents
+};
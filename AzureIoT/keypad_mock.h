@@ -0,0 +1,5 @@
+#pragma once
+#include <stdbool.h>
+
+void setMockKey(int row, int column, bool pressed);
+long getMockKeypadAccesses();
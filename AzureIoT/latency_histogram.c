@@ -0,0 +1,120 @@
+#include "latency_histogram.h"
+
+#include <stdio.h>
+
+/**
+* Get bucket of a value, values below LATENCY_SUB_BUCKETS have a bucket each.
+*/
+static int getBucket(long us)
+{
+	if (us < LATENCY_SUB_BUCKETS)
+		return us < 0 ? 0 : (int)us;
+
+	int exponent = 63 - __builtin_clzll((unsigned long long)us);
+	if (exponent > LATENCY_MAX_EXPONENT)
+		return LATENCY_BUCKET_COUNT - 1;
+
+	int subBucket = (int)(us >> (exponent - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+	return (exponent - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS + subBucket;
+}
+
+/**
+* Get largest value that falls into a bucket.
+*/
+static long getBucketUpperBound(int bucket)
+{
+	if (bucket < LATENCY_SUB_BUCKETS)
+		return bucket;
+
+	int exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKET_BITS - 1;
+	long subBucket = bucket % LATENCY_SUB_BUCKETS;
+	int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+	return ((LATENCY_SUB_BUCKETS + subBucket + 1) << shift) - 1;
+}
+
+/**
+* Add a value to the histogram.
+*
+* @param histogram Histogram to add to.
+* @param us Latency in microseconds.
+*/
+void recordLatency(struct latencyHistogram *histogram, long us)
+{
+	atomic_fetch_add_explicit(&histogram->counts[getBucket(us)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->total, 1, memory_order_relaxed);
+
+	long max = atomic_load_explicit(&histogram->maxUs, memory_order_relaxed);
+	while (us > max && !atomic_compare_exchange_weak_explicit(&histogram->maxUs, &max, us, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+/**
+* Add time elapsed since given CLOCK_MONOTONIC time to the histogram.
+*/
+void recordLatencySince(struct latencyHistogram *histogram, const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	recordLatency(histogram, (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+/**
+* Forget all values, values recorded meanwhile by other threads may be lost.
+*/
+void resetLatencyHistogram(struct latencyHistogram *histogram)
+{
+	for (int i = 0; i < LATENCY_BUCKET_COUNT; i++)
+		atomic_store_explicit(&histogram->counts[i], 0, memory_order_relaxed);
+	atomic_store_explicit(&histogram->total, 0, memory_order_relaxed);
+	atomic_store_explicit(&histogram->maxUs, 0, memory_order_relaxed);
+}
+
+unsigned getLatencyCount(struct latencyHistogram *histogram)
+{
+	return atomic_load_explicit(&histogram->total, memory_order_relaxed);
+}
+
+/**
+* Get latency given share of values is below.
+*
+* @param histogram Histogram to look at.
+* @param percentile Share in percent, 50 for median.
+* @return Upper bound of the bucket the percentile falls into, never above the largest value, or 0 if histogram is empty.
+*/
+long getLatencyPercentile(struct latencyHistogram *histogram, double percentile)
+{
+	unsigned total = getLatencyCount(histogram);
+	if (total == 0)
+		return 0;
+
+	unsigned wanted = (unsigned)(total * percentile / 100.0 + 0.5);
+	if (wanted < 1)
+		wanted = 1;
+
+	long max = atomic_load_explicit(&histogram->maxUs, memory_order_relaxed);
+	unsigned seen = 0;
+	for (int i = 0; i < LATENCY_BUCKET_COUNT; i++)
+	{
+		seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+		if (seen >= wanted)
+		{
+			long bound = getBucketUpperBound(i);
+			return bound < max ? bound : max;
+		}
+	}
+	return max;
+}
+
+/**
+* Write percentiles of the histogram as short text, like "p50 800 p90 1200 p99 4000 max 5100 n 42" in microseconds.
+*
+* @return Length of the text or -1 if it didn't fit.
+*/
+int formatLatencySummary(struct latencyHistogram *histogram, char *buffer, size_t size)
+{
+	int length = snprintf(buffer, size, "p50 %ld p90 %ld p99 %ld max %ld n %u",
+		getLatencyPercentile(histogram, 50), getLatencyPercentile(histogram, 90), getLatencyPercentile(histogram, 99),
+		atomic_load_explicit(&histogram->maxUs, memory_order_relaxed), getLatencyCount(histogram));
+
+	return length < 0 || (size_t)length >= size ? -1 : length;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+#define LATENCY_SUB_BUCKET_BITS 3 /*!< Every power of two is split into 2^bits buckets, values are kept within 12.5%. */
+#define LATENCY_MAX_EXPONENT 30 /*!< Largest power of two kept, bigger values count into the last bucket. */
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKET_COUNT ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+/**
+* Distribution of latencies in microseconds with logarithmic buckets of constant relative precision.
+*
+* Recording is a few atomic increments, so any thread may record while another one reads.
+*/
+struct latencyHistogram {
+	const char *name; /**< Name used in summaries and telemetry. */
+	atomic_uint counts[LATENCY_BUCKET_COUNT]; /**< Number of values in every bucket. */
+	atomic_uint total; /**< Number of recorded values. */
+	atomic_long maxUs; /**< Largest recorded value. */
+};
+
+void recordLatency(struct latencyHistogram *histogram, long us);
+void recordLatencySince(struct latencyHistogram *histogram, const struct timespec *start);
+void resetLatencyHistogram(struct latencyHistogram *histogram);
+
+unsigned getLatencyCount(struct latencyHistogram *histogram);
+long getLatencyPercentile(struct latencyHistogram *histogram, double percentile);
+int formatLatencySummary(struct latencyHistogram *histogram, char *buffer, size_t size);
@@ -0,0 +1,501 @@
+#include "lock_actuator.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <applibs/log.h>
+#include "epoll_timerfd_utilities.h"
+#include "gpio_port.h"
+
+#if defined(__has_include) && __has_include(<applibs/pwm.h>)
+#include <applibs/pwm.h>
+#define HAS_PWM 1
+#endif
+
+#define PWM_CHANNELS_PER_CONTROLLER 4 /*!< MT3620 GPIO n is channel n % 4 of PWM controller n / 4. */
+#define PWM_CONTROLLER_COUNT 3 /*!< Only GPIO 0 to 11 can be PWM outputs. */
+
+static enum lockActuatorDriver driver = LOCK_ACTUATOR_THREAD; /*!< Driver chosen by initLockActuator(). */
+static LockActuatedFunction actuatedFunction = NULL; /*!< Called once the running actuation is over. */
+static atomic_bool busy; /*!< True from actuateLock() until the actuated function was called. */
+static int doneEventFd = -1; /*!< Readable on the app epoll once the running actuation is over. */
+static atomic_int doneResult; /*!< Result of the finished actuation, written before doneEventFd. */
+
+static int lockPins[LOCK_ACTUATOR_MAX_LOCKS]; /*!< GPIO of every lock. */
+static int lockCount = 0; /*!< Number of locks. */
+static int activeLock = 0; /*!< Lock of the running actuation. */
+static struct gpioPort lockPorts[LOCK_ACTUATOR_MAX_LOCKS]; /*!< Outputs of the thread driver, bit 0 is the pin of the lock. */
+static int workerEpollFd = -1; /*!< Epoll of the worker thread. */
+static int edgeTimerFd = -1; /*!< Absolute deadline of the next edge. */
+static int requestEventFd = -1; /*!< Written to hand an actuation to the worker thread. */
+static int stopEventFd = -1; /*!< Written to make the worker thread exit. */
+static pthread_t workerThread; /*!< Thread generating pulses. */
+static bool workerThreadRunning = false; /*!< True between starting and joining workerThread. */
+static bool workerStop = false; /*!< Set on the worker thread to leave its loop. */
+static struct gpioPort *sensorPort = NULL; /*!< Sensor ending the requested actuation early, NULL to run for its whole duration. */
+static uint8_t sensorMask = 0; /*!< Sensor pins watched by the requested actuation. */
+static uint8_t sensorReachedValue = 0; /*!< Value of watched pins that ends the requested actuation. */
+static int requestedPulseUs = 0; /*!< Pulse width of the requested actuation, written before requestEventFd. */
+static int requestedDurationMs = 0; /*!< Duration of the requested actuation, written before requestEventFd. */
+static struct timespec periodStart; /*!< Start of the current servo period. */
+static struct timespec actuationEnd; /*!< No period starts at or after this time. */
+static bool isPulseHigh = false; /*!< True while the output is high within a period. */
+
+static int pwmFds[PWM_CONTROLLER_COUNT] = { -1, -1, -1 }; /*!< PWM controllers of the locks, opened only if some lock needs them. */
+static int durationTimerFd = -1; /*!< Timer ending a PWM actuation, periodic while a sensor is watched. */
+static struct timespec pwmEnd; /*!< Time PWM actuation watching a sensor times out. */
+
+static void addUs(struct timespec *t, long us)
+{
+	t->tv_nsec += us * 1000;
+	t->tv_sec += t->tv_nsec / 1000000000L;
+	t->tv_nsec %= 1000000000L;
+}
+
+static bool isBefore(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/**
+* Hand the result of an actuation over to the app loop.
+*/
+static void signalDone(int result)
+{
+	atomic_store(&doneResult, result);
+	const uint64_t one = 1;
+	if (write(doneEventFd, &one, sizeof(one)) != sizeof(one))
+		Log_Debug("ERROR: Could not signal lock actuation: %s (%d).\n", strerror(errno), errno);
+}
+
+/**
+* Arm the edge timer to an absolute time, so pulses don't drift with handler latency.
+*/
+static int armEdge(const struct timespec *at)
+{
+	const struct itimerspec deadline = { { 0, 0 }, *at };
+	return timerfd_settime(edgeTimerFd, TFD_TIMER_ABSTIME, &deadline, NULL);
+}
+
+/**
+* Check if the sensor of the actuation reached its value, read once per servo period.
+*
+* @return 1 if it did, 0 if not or there is no sensor, -1 if it can't be read.
+*/
+static int isSensorReached()
+{
+	if (sensorPort == NULL)
+		return 0;
+
+	uint8_t value;
+	if (readGpioPort(sensorPort, sensorMask, &value) < 0)
+		return -1;
+
+	return (value & sensorMask) == sensorReachedValue;
+}
+
+/**
+* Start a period with the output high, or finish the actuation once the sensor confirms or its time is over.
+*/
+static int startPeriod()
+{
+	int reached = isSensorReached();
+	if (reached < 0)
+		return -1;
+
+	if (reached)
+	{
+		signalDone(LOCK_ACTUATION_DONE);
+		return 0;
+	}
+	if (!isBefore(&periodStart, &actuationEnd))
+	{
+		signalDone(sensorPort != NULL ? LOCK_ACTUATION_TIMED_OUT : LOCK_ACTUATION_DONE);
+		return 0;
+	}
+
+	if (writeGpioPort(&lockPorts[activeLock], 1) < 0)
+		return -1;
+
+	isPulseHigh = true;
+	struct timespec fallAt = periodStart;
+	addUs(&fallAt, requestedPulseUs);
+	return armEdge(&fallAt);
+}
+
+static void requestEventHandler(EventData *eventData)
+{
+	uint64_t count;
+	if (read(requestEventFd, &count, sizeof(count)) != sizeof(count))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &periodStart);
+	actuationEnd = periodStart;
+	addUs(&actuationEnd, requestedDurationMs * 1000L);
+	if (startPeriod() < 0)
+		signalDone(LOCK_ACTUATION_FAILED);
+}
+
+/**
+* Pulse ends or next period starts.
+*/
+static void edgeTimerEventHandler(EventData *eventData)
+{
+	if (ConsumeTimerFdEvent(edgeTimerFd) != 0)
+	{
+		signalDone(LOCK_ACTUATION_FAILED);
+		return;
+	}
+
+	int result;
+	if (isPulseHigh)
+	{
+		isPulseHigh = false;
+		addUs(&periodStart, LOCK_SERVO_PERIOD_US);
+		result = writeGpioPort(&lockPorts[activeLock], 0);
+		if (result == 0)
+			result = armEdge(&periodStart);
+	}
+	else
+		result = startPeriod();
+
+	if (result < 0)
+		signalDone(LOCK_ACTUATION_FAILED);
+}
+
+static void stopEventHandler(EventData *eventData)
+{
+	workerStop = true;
+}
+
+static EventData requestEventData = { .eventHandler = &requestEventHandler };
+static EventData edgeTimerEventData = { .eventHandler = &edgeTimerEventHandler };
+static EventData stopEventData = { .eventHandler = &stopEventHandler };
+
+/**
+* Worker thread, generates pulses no matter what the app loop is busy with.
+*/
+static void *workerThreadMain(void *arg)
+{
+	while (!workerStop)
+	{
+		if (WaitForEventAndCallHandler(workerEpollFd) != 0)
+			break;
+	}
+	return NULL;
+}
+
+static int initThreadDriver()
+{
+	for (int i = 0; i < lockCount; i++)
+	{
+		if (openGpioPort(&lockPorts[i], GPIO_DRIVER, &lockPins[i], 1, GPIO_PORT_OUTPUT | GPIO_PORT_OPEN_DRAIN, 1) < 0)
+			return -1;
+	}
+
+	workerStop = false;
+	workerEpollFd = CreateEpollFd();
+	if (workerEpollFd < 0)
+		return -1;
+
+	edgeTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (edgeTimerFd < 0 || RegisterEventHandlerToEpoll(workerEpollFd, edgeTimerFd, &edgeTimerEventData, EPOLLIN) < 0)
+		return -1;
+
+	requestEventFd = eventfd(0, EFD_CLOEXEC);
+	if (requestEventFd < 0 || RegisterEventHandlerToEpoll(workerEpollFd, requestEventFd, &requestEventData, EPOLLIN) < 0)
+		return -1;
+
+	stopEventFd = eventfd(0, EFD_CLOEXEC);
+	if (stopEventFd < 0 || RegisterEventHandlerToEpoll(workerEpollFd, stopEventFd, &stopEventData, EPOLLIN) < 0)
+		return -1;
+
+	//thread owns the pins from now on
+	if (pthread_create(&workerThread, NULL, workerThreadMain, NULL) != 0)
+		return -1;
+
+	workerThreadRunning = true;
+	return 0;
+}
+
+#ifdef HAS_PWM
+static int applyPwm(int widthUs, bool enabled)
+{
+	const PwmState state = {
+		.period_nsec = LOCK_SERVO_PERIOD_US * 1000,
+		.dutyCycle_nsec = widthUs * 1000,
+		.polarity = PWM_Polarity_Normal,
+		.enabled = enabled
+	};
+	int pin = lockPins[activeLock];
+	return PWM_Apply(pwmFds[pin / PWM_CHANNELS_PER_CONTROLLER], pin % PWM_CHANNELS_PER_CONTROLLER, &state);
+}
+#else
+static int applyPwm(int widthUs, bool enabled)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+/**
+* Stop the pulses and report the result of a PWM actuation.
+*/
+static void finishPwm(int result)
+{
+	const struct timespec disarmed = { 0, 0 };
+	SetTimerFdToPeriod(durationTimerFd, &disarmed);
+	signalDone(applyPwm(0, false) < 0 ? LOCK_ACTUATION_FAILED : result);
+}
+
+/**
+* PWM actuation is over or it is time to look at its sensor.
+*/
+static void durationTimerEventHandler(EventData *eventData)
+{
+	if (ConsumeTimerFdEvent(durationTimerFd) != 0)
+	{
+		finishPwm(LOCK_ACTUATION_FAILED);
+		return;
+	}
+
+	if (sensorPort == NULL)
+	{
+		finishPwm(LOCK_ACTUATION_DONE);
+		return;
+	}
+
+	int reached = isSensorReached();
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (reached != 0)
+		finishPwm(reached < 0 ? LOCK_ACTUATION_FAILED : LOCK_ACTUATION_DONE);
+	else if (!isBefore(&now, &pwmEnd))
+		finishPwm(LOCK_ACTUATION_TIMED_OUT);
+}
+
+static EventData durationTimerEventData = { .eventHandler = &durationTimerEventHandler };
+
+static int initPwmDriver(int epollFd)
+{
+	for (int i = 0; i < lockCount; i++)
+	{
+		int controller = lockPins[i] / PWM_CHANNELS_PER_CONTROLLER;
+		if (controller >= PWM_CONTROLLER_COUNT)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		if (pwmFds[controller] >= 0)
+			continue;
+
+#ifdef HAS_PWM
+		pwmFds[controller] = PWM_Open(controller);
+#else
+		errno = ENOSYS;
+#endif
+		if (pwmFds[controller] < 0)
+			return -1;
+	}
+
+	const struct timespec disarmed = { 0, 0 };
+	durationTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &disarmed, &durationTimerEventData, EPOLLIN);
+	if (durationTimerFd < 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+* Actuation is over, let the app know from its own loop.
+*/
+static void doneEventHandler(EventData *eventData)
+{
+	uint64_t count;
+	if (read(doneEventFd, &count, sizeof(count)) != sizeof(count))
+		return;
+
+	LockActuatedFunction actuated = actuatedFunction;
+	actuatedFunction = NULL;
+	atomic_store(&busy, false);
+
+	//function may start the next actuation right away
+	if (actuated != NULL)
+		actuated(atomic_load(&doneResult));
+}
+
+static EventData doneEventData = { .eventHandler = &doneEventHandler };
+
+/**
+* Take the lock pins and get ready to drive their servos, one lock at a time.
+*
+* @param epollFd Epoll of the app loop, actuated functions are called from it.
+* @param lockDriver How pulses are generated.
+* @param pins GPIO of every servo, for LOCK_ACTUATOR_PWM also selects PWM controller and channel.
+* @param count Number of locks, at most LOCK_ACTUATOR_MAX_LOCKS.
+* @return 0 or -1 if something went wrong.
+*/
+int initLockActuator(int epollFd, enum lockActuatorDriver lockDriver, const int *pins, int count)
+{
+	if (count < 1 || count > LOCK_ACTUATOR_MAX_LOCKS)
+		return -1;
+
+	for (int i = 0; i < count; i++)
+		lockPins[i] = pins[i];
+	lockCount = count;
+	activeLock = 0;
+	driver = lockDriver;
+	atomic_store(&busy, false);
+	actuatedFunction = NULL;
+
+	doneEventFd = eventfd(0, EFD_CLOEXEC);
+	if (doneEventFd < 0 || RegisterEventHandlerToEpoll(epollFd, doneEventFd, &doneEventData, EPOLLIN) < 0)
+		return -1;
+
+	int result = driver == LOCK_ACTUATOR_PWM ? initPwmDriver(epollFd) : initThreadDriver();
+	if (result < 0)
+		Log_Debug("ERROR: Could not set up lock actuator: %s (%d).\n", strerror(errno), errno);
+
+	return result;
+}
+
+void cleanupLockActuator()
+{
+	if (workerThreadRunning)
+	{
+		const uint64_t stop = 1;
+		if (write(stopEventFd, &stop, sizeof(stop)) == sizeof(stop))
+			pthread_join(workerThread, NULL);
+		workerThreadRunning = false;
+	}
+
+	if (driver == LOCK_ACTUATOR_PWM && isLockActuating())
+		applyPwm(0, false);
+
+	CloseFdAndPrintError(stopEventFd, "Lock stop event");
+	CloseFdAndPrintError(requestEventFd, "Lock request event");
+	CloseFdAndPrintError(edgeTimerFd, "Lock edge timer");
+	CloseFdAndPrintError(workerEpollFd, "Lock epoll");
+	CloseFdAndPrintError(durationTimerFd, "Lock duration timer");
+	for (int i = 0; i < PWM_CONTROLLER_COUNT; i++)
+	{
+		CloseFdAndPrintError(pwmFds[i], "Lock PWM");
+		pwmFds[i] = -1;
+	}
+	CloseFdAndPrintError(doneEventFd, "Lock done event");
+	for (int i = 0; i < lockCount; i++)
+		closeGpioPort(&lockPorts[i]);
+	stopEventFd = -1;
+	requestEventFd = -1;
+	edgeTimerFd = -1;
+	workerEpollFd = -1;
+	durationTimerFd = -1;
+	doneEventFd = -1;
+	lockCount = 0;
+}
+
+/**
+* Start PWM pulses, timer ends them after the duration or looks at the sensor every servo period.
+*/
+static int startPwm(int positionUs, int durationMs)
+{
+	if (applyPwm(positionUs, true) < 0)
+		return -1;
+
+	if (sensorPort != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &pwmEnd);
+		addUs(&pwmEnd, durationMs * 1000L);
+		const struct timespec period = { 0, LOCK_SERVO_PERIOD_US * 1000L };
+		return SetTimerFdToPeriod(durationTimerFd, &period);
+	}
+
+	struct timespec duration = { durationMs / 1000, (durationMs % 1000) * 1000000L };
+	//zero would disarm the timer and the actuation would never end
+	if (durationMs == 0)
+		duration.tv_nsec = 1;
+	return SetTimerFdToSingleExpiry(durationTimerFd, &duration);
+}
+
+/**
+* Drive the servo of a lock to a position for a while without waiting for it.
+*
+* Pulses are generated by the PWM peripheral or the worker thread, the app loop only gets the
+* actuated function called once the time is over.
+*
+* @param lock Index of the lock in pins given to initLockActuator().
+* @param positionUs Pulse width of the position, 1000 to 2000 for common servos.
+* @param durationMs How long the position is held.
+* @param actuated Called from the app loop with a lockActuationResult once the actuation is over, may be NULL.
+* @return 0 or -1 if something went wrong or another actuation is running, actuated is not called then.
+*/
+int actuateLock(int lock, int positionUs, int durationMs, LockActuatedFunction actuated)
+{
+	return actuateLockUntil(lock, positionUs, durationMs, NULL, 0, 0, actuated);
+}
+
+/**
+* Drive the servo of a lock to a position until a sensor confirms it got there.
+*
+* Sensor is read once per servo period, pulses stop at the first period its watched pins read reachedValue.
+*
+* @param lock Index of the lock in pins given to initLockActuator().
+* @param positionUs Pulse width of the position.
+* @param timeoutMs Longest time the position is driven, actuated gets LOCK_ACTUATION_TIMED_OUT after it.
+* @param sensor Input port to watch, NULL to drive for the whole timeout.
+* @param mask Pins of the port that are watched.
+* @param reachedValue Value of watched pins that ends the actuation.
+* @param actuated Called from the app loop with a lockActuationResult once the actuation is over, may be NULL.
+* @return 0 or -1 if something went wrong or another actuation is running, actuated is not called then.
+*/
+int actuateLockUntil(int lock, int positionUs, int timeoutMs, struct gpioPort *sensor, uint8_t mask, uint8_t reachedValue, LockActuatedFunction actuated)
+{
+	if (lock < 0 || lock >= lockCount || positionUs <= 0 || positionUs >= LOCK_SERVO_PERIOD_US || timeoutMs < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (atomic_exchange(&busy, true))
+	{
+		errno = EBUSY;
+		return -1;
+	}
+
+	actuatedFunction = actuated;
+	activeLock = lock;
+	sensorPort = sensor;
+	sensorMask = mask;
+	sensorReachedValue = reachedValue & mask;
+	int result;
+	if (driver == LOCK_ACTUATOR_PWM)
+		result = startPwm(positionUs, timeoutMs);
+	else
+	{
+		requestedPulseUs = positionUs;
+		requestedDurationMs = timeoutMs;
+		const uint64_t one = 1;
+		result = write(requestEventFd, &one, sizeof(one)) == sizeof(one) ? 0 : -1;
+	}
+
+	if (result < 0)
+	{
+		actuatedFunction = NULL;
+		atomic_store(&busy, false);
+	}
+	return result;
+}
+
+/**
+* Tell if an actuation is running, a new one can't be started until its actuated function was called.
+*/
+bool isLockActuating()
+{
+	return atomic_load(&busy);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOCK_SERVO_PERIOD_US 20000 /*!< Period of servo pulses, width of a pulse sets servo position. */
+#define LOCK_ACTUATOR_MAX_LOCKS 32 /*!< Maximum number of locks, only one of them is driven at a time. */
+
+/**
+* How servo pulses of the lock are generated.
+*/
+enum lockActuatorDriver {
+	LOCK_ACTUATOR_THREAD, /**< GPIO toggled by a worker thread on absolute timerfd deadlines. */
+	LOCK_ACTUATOR_PWM /**< MT3620 PWM peripheral, needs the pin's PWM controller in the app manifest instead of the GPIO. */
+};
+
+/**
+* Result an actuated function gets.
+*/
+enum lockActuationResult {
+	LOCK_ACTUATION_FAILED = -1, /**< Pulses couldn't be generated. */
+	LOCK_ACTUATION_DONE = 0, /**< Duration is over or sensor reached its value. */
+	LOCK_ACTUATION_TIMED_OUT = 1 /**< Sensor didn't reach its value in time. */
+};
+
+struct gpioPort;
+
+typedef void (*LockActuatedFunction)(int result);
+
+int initLockActuator(int epollFd, enum lockActuatorDriver driver, const int *pins, int count);
+void cleanupLockActuator();
+
+int actuateLock(int lock, int positionUs, int durationMs, LockActuatedFunction actuated);
+int actuateLockUntil(int lock, int positionUs, int timeoutMs, struct gpioPort *sensor, uint8_t mask, uint8_t reachedValue, LockActuatedFunction actuated);
+bool isLockActuating();
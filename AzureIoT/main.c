@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <limits.h>
 
 // applibs_versions.h defines the API struct versions to use for applibs APIs.
 #include "applibs_versions.h"
@@ -63,6 +64,7 @@ static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *
 static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
                          size_t payloadSize, void *userContextCallback);
 static void TwinReportBoolState(const char *propertyName, bool propertyValue);
+static int GetTwinInt(const JSON_Object *properties, const char *propertyName);
 static void ReportStatusCallback(int result, void *context);
 static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
 static const char *getAzureSphereProvisioningResultString(
@@ -77,7 +79,6 @@ static void ClosePeripheralsAndHandlers(void);
 
 // Timer / polling
 static int azureTimerFd = -1;
-static int appTimerFd = -1;
 static int epollFd = -1;
 
 // Azure IoT poll periods
@@ -119,9 +120,10 @@ int main(int argc, char *argv[])
 	
 
 	// Use epoll to wait for events and trigger handlers, until an error or SIGTERM happens
+	// App goes through whatever the last event changed before the loop sleeps again
 	while (!terminationRequired)
 	{
-		if (WaitForEventAndCallHandler(epollFd) != 0)
+		if (runApp() != 0 || WaitForEventAndCallHandler(epollFd) != 0)
 			terminationRequired = true;
 	}
 
@@ -158,22 +160,6 @@ static void AzureTimerEventHandler(EventData *eventData)
 
 static EventData azureEventData = {.eventHandler = &AzureTimerEventHandler};
 
-static void appTimerEventHandler(EventData* eventData)
-{
-	if (runApp() != 0)
-	{
-		terminationRequired = true;
-		return;
-	}
-
-
-	if (ConsumeTimerFdEvent(appTimerFd) != 0)
-	{
-		terminationRequired = true;
-		return;
-	}
-}
-
 /// <summary>
 ///     Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
 /// </summary>
@@ -198,19 +184,11 @@ static int InitPeripheralsAndHandlers(void)
         return -1;
     }
 
-	int result = initApp();
+	int result = initApp(epollFd);
 	if (result < 0) {
 		return -1;
 	}
 
-	struct timespec appUpdatePeriod = { .tv_sec = 0,.tv_nsec = 10000000 };//every 10ms
-	static EventData appEventData = { .eventHandler = &appTimerEventHandler };
-
-	appTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &appUpdatePeriod, &appEventData, EPOLLIN);
-	if (appTimerFd < 0) {
-		return -1;
-	}
-
     return 0;
 }
 
@@ -328,12 +306,41 @@ static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
         desiredProperties = rootObject;
     }
 
+    // Lockout durations, properties missing from the update keep their current value.
+    int invalidCodeMs = GetTwinInt(desiredProperties, "invalidCodeMs");
+    int lockoutSeconds = GetTwinInt(desiredProperties, "lockoutSeconds");
+    int maxLockoutSeconds = GetTwinInt(desiredProperties, "maxLockoutSeconds");
+    if ((invalidCodeMs >= 0 || lockoutSeconds >= 0 || maxLockoutSeconds >= 0) &&
+        setLockoutDurations(invalidCodeMs, lockoutSeconds, maxLockoutSeconds) != 0) {
+        Log_Debug("WARNING: Ignoring lockout durations, maxLockoutSeconds is below lockoutSeconds.\n");
+    }
+
 cleanup:
     // Release the allocated memory.
     json_value_free(rootProperties);
     free(nullTerminatedJsonString);
 }
 
+/// <summary>
+///     Gets a non-negative integer Device Twin property.
+/// </summary>
+/// <param name="properties">the desired properties of the update</param>
+/// <param name="propertyName">the IoT Hub Device Twin property name</param>
+/// <returns>the value or -1 if the property is missing or not a non-negative integer</returns>
+static int GetTwinInt(const JSON_Object *properties, const char *propertyName)
+{
+    JSON_Value *value = json_object_get_value(properties, propertyName);
+    if (value == NULL || json_value_get_type(value) != JSONNumber) {
+        return -1;
+    }
+
+    double number = json_value_get_number(value);
+    if (number < 0 || number > INT_MAX || number != (int)number) {
+        return -1;
+    }
+    return (int)number;
+}
+
 /// <summary>
 ///     Converts the IoT Hub connection status reason to a string.
 /// </summary>
@@ -0,0 +1,467 @@
+#include "scene.h"
+
+#include <string.h>
+
+#include "display.h"
+#include "display_list.h"
+#include "glyph.h"
+#include "text_field.h"
+
+/**
+* Inclusive region of the screen covered by a node, empty if startX > endX.
+*/
+struct sceneBounds {
+	int startX; /**< Leftmost column. */
+	int startY; /**< Topmost row. */
+	int endX; /**< Rightmost column. */
+	int endY; /**< Bottom row. */
+};
+
+/**
+* Recorded full repaint of a scene.
+*/
+struct sceneCacheSlot {
+	uint32_t hash; /**< Hash of the recorded scene. */
+	unsigned lastUsed; /**< Value of sceneCacheClock when the slot was last recorded or found, 0 if never. */
+	struct displayList list; /**< Recorded scene. */
+};
+
+#if SCENE_CACHE_SLOTS % SCENE_CACHE_WAYS != 0
+#error SCENE_CACHE_SLOTS has to be a multiple of SCENE_CACHE_WAYS
+#endif
+
+static struct scene presentedScene; /*!< Scene currently on the display. */
+static struct textField presentedText[SCENE_MAX_NODES]; /*!< Text fields of presented text nodes, node text points into them. */
+static bool isScenePresented = false; /*!< False until a scene is presented. */
+static struct sceneCacheSlot sceneCache[SCENE_CACHE_SLOTS]; /*!< Recorded scenes, sets of SCENE_CACHE_WAYS slots indexed by hash. */
+static unsigned sceneCacheClock = 0; /*!< Counts cache lookups to find the least recently used slot of a set. */
+
+/**
+* Start empty scene.
+*
+* @param scene Scene to be set up.
+* @param backgroundColor Color of the whole screen behind the nodes.
+*/
+void initScene(struct scene* scene, uint32_t backgroundColor)
+{
+	scene->backgroundColor = backgroundColor;
+	scene->nodeCount = 0;
+	scene->overflow = false;
+}
+
+/**
+* Append node to the scene, marks the scene overflown if it is full.
+*
+* @return Node to be filled or NULL if scene is full.
+*/
+static struct sceneNode* addSceneNode(struct scene* scene, enum sceneNodeType type)
+{
+	if (scene->nodeCount == SCENE_MAX_NODES)
+	{
+		scene->overflow = true;
+		return NULL;
+	}
+
+	struct sceneNode* node = &scene->nodes[scene->nodeCount++];
+	memset(node, 0, sizeof(*node));
+	node->type = type;
+	return node;
+}
+
+/**
+* Add line of text to the scene.
+*
+* @param scene Scene to add to.
+* @param text Text to be shown, has to stay valid until the scene is presented.
+* @param x Leftmost side of the text.
+* @param y Topmost side of the text.
+* @param color Color of the text.
+* @param backgroundColor Color of the pixels around the characters.
+*/
+void addSceneText(struct scene* scene, const char* text, int x, int y, uint32_t color, uint32_t backgroundColor)
+{
+	if (strlen(text) > TEXT_FIELD_MAX_LENGTH)
+	{
+		scene->overflow = true;
+		return;
+	}
+
+	struct sceneNode* node = addSceneNode(scene, SCENE_TEXT);
+	if (node == NULL)
+		return;
+
+	node->x = x;
+	node->y = y;
+	node->color = color;
+	node->backgroundColor = backgroundColor;
+	node->text = text;
+}
+
+/**
+* Add line to the scene.
+*
+* @param scene Scene to add to.
+* @param startX Horizontal position of the start of the line.
+* @param startY Vertical position of the start of the line.
+* @param endX Horizontal position of the end of the line.
+* @param endY Vertical position of the end of the line.
+* @param color Color of the line.
+*/
+void addSceneLine(struct scene* scene, int startX, int startY, int endX, int endY, uint32_t color)
+{
+	struct sceneNode* node = addSceneNode(scene, SCENE_LINE);
+	if (node == NULL)
+		return;
+
+	node->x = startX;
+	node->y = startY;
+	node->endX = endX;
+	node->endY = endY;
+	node->color = color;
+}
+
+/**
+* Get region of the screen covered by the node.
+*/
+static struct sceneBounds getNodeBounds(const struct sceneNode* node)
+{
+	struct sceneBounds b = { node->x, node->y, node->x, node->y };
+
+	switch (node->type)
+	{
+	case SCENE_TEXT:
+		b.startY = node->y - GLYPH_TOP_OFFSET;
+		b.endY = b.startY + GLYPH_HEIGHT - 1;
+		b.endX = node->x - 2;//last character isn't followed by spacing
+		for (const char* c = node->text; *c != '\0'; c++)
+		{
+			const struct fontGlyph *g = getGlyph(*c);
+			if (g != NULL)
+				b.endX += g->advance;
+		}
+		break;
+	case SCENE_LINE:
+		b.startX = node->x < node->endX ? node->x : node->endX;
+		b.startY = node->y < node->endY ? node->y : node->endY;
+		b.endX = node->x > node->endX ? node->x : node->endX;
+		b.endY = node->y > node->endY ? node->y : node->endY;
+		break;
+	}
+
+	return b;
+}
+
+/**
+* Check whether two regions share any pixel.
+*/
+static bool boundsIntersect(const struct sceneBounds* a, const struct sceneBounds* b)
+{
+	return a->startX <= a->endX && b->startX <= b->endX
+		&& a->startX <= b->endX && b->startX <= a->endX && a->startY <= b->endY && b->startY <= a->endY;
+}
+
+/**
+* Check whether nodes differ at most in their text, such nodes are updated in place.
+*/
+static bool haveSameLayout(const struct sceneNode* a, const struct sceneNode* b)
+{
+	return a->type == b->type && a->x == b->x && a->y == b->y && a->endX == b->endX && a->endY == b->endY
+		&& a->color == b->color && a->backgroundColor == b->backgroundColor;
+}
+
+/**
+* Draw node on top of whatever is on the screen.
+*
+* @param node Node to be drawn.
+* @param field Text field the text node is drawn through, set up here.
+* @return 0 or -1 if something went wrong.
+*/
+static int drawSceneNode(const struct sceneNode* node, struct textField* field)
+{
+	switch (node->type)
+	{
+	case SCENE_TEXT:
+		initTextField(field, node->x, node->y, node->color, node->backgroundColor, false);
+		return setTextFieldText(field, node->text);
+	case SCENE_LINE:
+		return drawLine(node->x, node->y, node->endX, node->endY, node->color);
+	}
+
+	return -1;
+}
+
+/**
+* Draw the whole scene starting with its background, used as display list draw function.
+*/
+static int drawWholeScene(void* context)
+{
+	const struct scene* scene = context;
+	struct textField field;
+
+	if (fillScreen(scene->backgroundColor) < 0)
+		return -1;
+
+	for (int i = 0; i < scene->nodeCount; i++)
+	{
+		if (drawSceneNode(&scene->nodes[i], &field) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+* Mix bytes into FNV-1a hash.
+*/
+static uint32_t hashBytes(uint32_t hash, const void* data, size_t length)
+{
+	const uint8_t* bytes = data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+* Get hash of everything that affects how the scene looks.
+*/
+static uint32_t hashScene(const struct scene* scene)
+{
+	uint32_t hash = hashBytes(2166136261u, &scene->backgroundColor, sizeof(scene->backgroundColor));
+	for (int i = 0; i < scene->nodeCount; i++)
+	{
+		const struct sceneNode* node = &scene->nodes[i];
+		int values[] = { node->type, node->x, node->y, node->endX, node->endY };
+		uint32_t colors[] = { node->color, node->backgroundColor };
+
+		hash = hashBytes(hash, values, sizeof(values));
+		hash = hashBytes(hash, colors, sizeof(colors));
+		if (node->type == SCENE_TEXT)
+			hash = hashBytes(hash, node->text, strlen(node->text) + 1);
+	}
+	return hash;
+}
+
+/**
+* Make sure the scene is recorded in the cache.
+*
+* Scene can go into any slot of its set, so two scenes whose hashes collide don't keep replacing each other.
+* If the scene is not recorded yet the least recently used slot of the set is recorded again.
+*
+* @param scene Scene to be recorded.
+* @return Slot holding the recorded scene or NULL if it couldn't be recorded.
+*/
+static struct sceneCacheSlot* recordScene(const struct scene* scene)
+{
+	uint32_t hash = hashScene(scene);
+	struct sceneCacheSlot* set = &sceneCache[hash % (SCENE_CACHE_SLOTS / SCENE_CACHE_WAYS) * SCENE_CACHE_WAYS];
+	struct sceneCacheSlot* slot = &set[0];
+	sceneCacheClock++;
+
+	for (int i = 0; i < SCENE_CACHE_WAYS; i++)
+	{
+		if (set[i].hash == hash && isDisplayListRecorded(&set[i].list))
+		{
+			set[i].lastUsed = sceneCacheClock;
+			return &set[i];
+		}
+
+		if (set[i].lastUsed < slot->lastUsed)
+			slot = &set[i];
+	}
+
+	slot->hash = hash;
+	slot->lastUsed = sceneCacheClock;
+	if (recordDisplayList(&slot->list, drawWholeScene, (void*)scene) < 0)
+		return NULL;
+
+	return slot;
+}
+
+/**
+* Repaint the whole screen.
+*
+* Scene is recorded into a display list the first time, later repaints replay it so only pixels that
+* differ from the current screen are flushed.
+*
+* @return 0 or -1 if something went wrong.
+*/
+static int repaintScene(const struct scene* scene)
+{
+	struct sceneCacheSlot* slot = recordScene(scene);
+	if (slot == NULL)
+		return drawWholeScene((void*)scene);//scene couldn't be recorded so just draw it
+
+	return replayDisplayList(&slot->list);
+}
+
+/**
+* Bring presented scene to the new one drawing only nodes that changed.
+*
+* Nodes are paired by layout. Paired text nodes are updated in place through their text fields so only
+* characters after the common beginning are redrawn. Nodes without a pair are erased with the background,
+* and every new node that overlaps erased area is drawn again. Text nodes should not overlap other nodes.
+*
+* @param scene Scene to be shown, has the same background as presented one.
+* @param fields Text fields of the new text nodes to be filled.
+* @return 0 or -1 if something went wrong.
+*/
+static int updateScene(const struct scene* scene, struct textField* fields)
+{
+	int pairs[SCENE_MAX_NODES];
+	bool paired[SCENE_MAX_NODES] = { false };
+	for (int i = 0; i < scene->nodeCount; i++)
+	{
+		pairs[i] = -1;
+		for (int j = 0; j < presentedScene.nodeCount; j++)
+		{
+			if (!paired[j] && haveSameLayout(&scene->nodes[i], &presentedScene.nodes[j]))
+			{
+				pairs[i] = j;
+				paired[j] = true;
+				break;
+			}
+		}
+	}
+
+	struct sceneBounds erased[SCENE_MAX_NODES];
+	int erasedCount = 0;
+	for (int j = 0; j < presentedScene.nodeCount; j++)
+	{
+		if (paired[j])
+			continue;
+
+		struct sceneBounds b = getNodeBounds(&presentedScene.nodes[j]);
+		if (b.startX > b.endX)
+			continue;
+
+		uint32_t color = presentedScene.backgroundColor;
+		if (drawRectangle(b.startX, b.startY, b.endX - b.startX, b.endY - b.startY, color, true, color) < 0)
+			return -1;
+
+		erased[erasedCount++] = b;
+	}
+
+	for (int i = 0; i < scene->nodeCount; i++)
+	{
+		const struct sceneNode* node = &scene->nodes[i];
+		struct sceneBounds b = getNodeBounds(node);
+
+		bool damaged = false;
+		for (int k = 0; k < erasedCount && !damaged; k++)
+			damaged = boundsIntersect(&b, &erased[k]);
+
+		if (pairs[i] >= 0 && node->type == SCENE_TEXT)
+		{
+			fields[i] = presentedText[pairs[i]];
+
+			//erasing may have taken part of the old text so clear it before drawing the new one
+			if (damaged && setTextFieldText(&fields[i], "") < 0)
+				return -1;
+
+			if (setTextFieldText(&fields[i], node->text) < 0)
+				return -1;
+			continue;
+		}
+
+		if (pairs[i] >= 0 && !damaged)
+			continue;
+
+		if (drawSceneNode(node, &fields[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+* Show the scene, drawing only what differs from the previously presented one.
+*
+* Scene with a different background is repainted as a whole. Drawing goes through display primitives
+* so the changes reach the panel on next flushDisplay().
+*
+* @param scene Scene to be shown.
+* @return 0 or -1 if scene overflowed or something went wrong.
+*/
+int presentScene(const struct scene* scene)
+{
+	struct textField fields[SCENE_MAX_NODES];
+
+	if (scene->overflow)
+		return -1;
+
+	memset(fields, 0, sizeof(fields));
+	int result;
+	if (!isScenePresented || scene->backgroundColor != presentedScene.backgroundColor)
+	{
+		result = repaintScene(scene);
+		for (int i = 0; i < scene->nodeCount && result == 0; i++)
+		{
+			const struct sceneNode* node = &scene->nodes[i];
+			if (node->type != SCENE_TEXT)
+				continue;
+
+			initTextField(&fields[i], node->x, node->y, node->color, node->backgroundColor, false);
+			result = assumeTextFieldText(&fields[i], node->text);
+		}
+	}
+	else
+	{
+		result = updateScene(scene, fields);
+	}
+
+	if (result < 0)
+	{
+		isScenePresented = false;//screen is in unknown state, repaint it next time
+		return -1;
+	}
+
+	//keep text in the text fields as node text belongs to the caller
+	presentedScene = *scene;
+	memcpy(presentedText, fields, sizeof(fields));
+	for (int i = 0; i < presentedScene.nodeCount; i++)
+	{
+		if (presentedScene.nodes[i].type == SCENE_TEXT)
+			presentedScene.nodes[i].text = presentedText[i].text;
+	}
+	isScenePresented = true;
+
+	return 0;
+}
+
+/**
+* Record scene ahead of time so showing it later costs only the replay and the flush.
+*
+* Nothing is done for a scene that is already recorded or that would be shown by diffing
+* the presented scene, as only full repaints use recorded scenes.
+*
+* @param scene Scene that is likely to be presented soon.
+* @return 0 or -1 if scene overflowed or couldn't be recorded.
+*/
+int prerenderScene(const struct scene* scene)
+{
+	if (scene->overflow)
+		return -1;
+
+	if (isScenePresented && scene->backgroundColor == presentedScene.backgroundColor)
+		return 0;
+
+	return recordScene(scene) != NULL ? 0 : -1;
+}
+
+/**
+* Release recorded scenes.
+*/
+void cleanupScenes()
+{
+	for (int i = 0; i < SCENE_CACHE_SLOTS; i++)
+	{
+		freeDisplayList(&sceneCache[i].list);
+		sceneCache[i].lastUsed = 0;
+	}
+	sceneCacheClock = 0;
+
+	isScenePresented = false;
+}
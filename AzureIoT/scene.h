@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCENE_MAX_NODES 8 /*!< Maximum number of nodes in a scene. */
+
+#ifndef SCENE_CACHE_SLOTS
+#define SCENE_CACHE_SLOTS 16 /*!< Number of recorded scenes kept for full repaints, including prerendered ones. */
+#endif
+
+#define SCENE_CACHE_WAYS 2 /*!< Slots a scene can be recorded in, SCENE_CACHE_SLOTS has to be a multiple of it. */
+
+/**
+* Kind of element in a scene.
+*/
+enum sceneNodeType {
+	SCENE_TEXT,
+	SCENE_LINE
+};
+
+/**
+* Single element of a scene, drawn with the display primitive of the same name.
+*/
+struct sceneNode {
+	enum sceneNodeType type; /**< Kind of the node. */
+	int x; /**< Leftmost side of the text or start of the line. */
+	int y; /**< Topmost side of the text or start of the line. */
+	int endX; /**< End of the line. */
+	int endY; /**< End of the line. */
+	uint32_t color; /**< Color of the text or line. */
+	uint32_t backgroundColor; /**< Color around characters of the text. */
+	const char *text; /**< Text of the node, has to stay valid until the scene is presented. */
+};
+
+/**
+* Whole screen described as a background and nodes drawn on top of it in order.
+*/
+struct scene {
+	uint32_t backgroundColor; /**< Color of the whole screen behind the nodes. */
+	struct sceneNode nodes[SCENE_MAX_NODES]; /**< Nodes of the scene. */
+	int nodeCount; /**< Number of valid entries in nodes. */
+	bool overflow; /**< Set if a node didn't fit, such scene can't be presented. */
+};
+
+void initScene(struct scene *scene, uint32_t backgroundColor);
+void addSceneText(struct scene *scene, const char *text, int x, int y, uint32_t color, uint32_t backgroundColor);
+void addSceneLine(struct scene *scene, int startX, int startY, int endX, int endY, uint32_t color);
+
+int presentScene(const struct scene *scene);
+int prerenderScene(const struct scene *scene);
+void cleanupScenes();
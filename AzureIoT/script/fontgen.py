@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# Converts GLCD font tables (like font.h) into compressed const font faces, see font_data.h.
+#
+# Usage: fontgen.py name=path [name=path ...] > font_data.c
+# Run from AzureIoT after changing a font: python3 script/fontgen.py font10x11=fonts/font10x11.h > font_data.c
+#
+# Every character is trimmed to the rows that contain ink and stored either as packed bits or as
+# run lengths, whichever is smaller. Widths and advances follow what glyph.c always computed:
+# true width is the last column with ink plus one and advance adds one column of spacing.
+
+import re
+import sys
+
+TOP_OFFSET = 3  # rows the second half of a character is shifted down by, also how far it reaches above y
+ENCODING_PACKED = 0
+ENCODING_RLE = 1
+
+
+def read_table(path):
+    with open(path) as f:
+        source = f.read()
+    source = re.sub(r'//.*', '', source)
+    source = re.sub(r'/\*.*?\*/', '', source, flags=re.S)
+    body = re.search(r'fontTable\[\]\s*=\s*\{(.*?)\}', source, re.S).group(1)
+    return [int(v, 0) for v in re.findall(r'0x[0-9A-Fa-f]+|\d+', body)]
+
+
+def decode_glyphs(table):
+    height = table[3]
+    first_char = table[4]
+    count = table[5]
+    widths = table[6:6 + count]
+    offset = 6 + count
+    glyphs = []
+    for width_in_words in widths:
+        rows = [0] * height
+        max_width = 0
+        for column in range(width_in_words):
+            bits = table[offset + column] | (table[offset + width_in_words + column] << TOP_OFFSET)
+            if bits and column > max_width:
+                max_width = column
+            for row in range(height):
+                if bits & (1 << row):
+                    rows[row] |= 1 << column
+        glyphs.append((max_width + 1, rows))
+        offset += width_in_words * 2
+    return height, first_char, glyphs
+
+
+def bit_stream(width, rows):
+    return [(row >> column) & 1 for row in rows for column in range(width)]
+
+
+def pack_bits(bits):
+    data = []
+    for i in range(0, len(bits), 8):
+        byte = 0
+        for j, bit in enumerate(bits[i:i + 8]):
+            byte |= bit << (7 - j)
+        data.append(byte)
+    return data
+
+
+def run_lengths(bits):
+    # runs alternate starting with unset pixels, nibble 15 means 15 more pixels of the same run
+    nibbles = []
+    color = 0
+    i = 0
+    while i < len(bits):
+        length = 0
+        while i < len(bits) and bits[i] == color:
+            length += 1
+            i += 1
+        while length >= 15:
+            nibbles.append(15)
+            length -= 15
+        nibbles.append(length)
+        color ^= 1
+    if len(nibbles) % 2:
+        nibbles.append(0)
+    return [(nibbles[i] << 4) | nibbles[i + 1] for i in range(0, len(nibbles), 2)]
+
+
+def encode_face(name, path):
+    height, first_char, glyphs = decode_glyphs(read_table(path))
+    data = []
+    entries = []
+    for width, rows in glyphs:
+        ink = [row for row in range(height) if rows[row]]
+        top = ink[0] if ink else 0
+        row_count = ink[-1] - top + 1 if ink else 0
+        bits = bit_stream(width, rows[top:top + row_count])
+        packed = pack_bits(bits)
+        rle = run_lengths(bits)
+        encoding, encoded = (ENCODING_RLE, rle) if len(rle) < len(packed) else (ENCODING_PACKED, packed)
+        entries.append((len(data), width, width + 1, top, row_count, encoding))
+        data.extend(encoded)
+    max_width = max(width for width, rows in glyphs)
+    return height, first_char, max_width, entries, data
+
+
+def main(args):
+    if not args or any('=' not in arg for arg in args):
+        sys.stderr.write('usage: fontgen.py name=path [name=path ...] > font_data.c\n')
+        return 2
+
+    out = sys.stdout
+    out.write('/* Generated by script/fontgen.py from %s, do not edit. */\n' % ', '.join(arg.split('=', 1)[1] for arg in args))
+    out.write('#include "font_data.h"\n')
+    for arg in args:
+        name, path = arg.split('=', 1)
+        height, first_char, max_width, entries, data = encode_face(name, path)
+        out.write('\nstatic const uint8_t %sData[] = {' % name)
+        for i, byte in enumerate(data):
+            out.write(('\n\t' if i % 16 == 0 else ' ') + '0x%02X,' % byte)
+        out.write('\n};\n\n')
+        out.write('static const struct fontGlyph %sGlyphs[] = {\n' % name)
+        for i, (offset, width, advance, top, row_count, encoding) in enumerate(entries):
+            out.write('\t{ %d, %d, %d, %d, %d, %s }, // %r\n' % (offset, width, advance, top, row_count,
+                'FONT_ENCODING_RLE' if encoding == ENCODING_RLE else 'FONT_ENCODING_PACKED', chr(first_char + i)))
+        out.write('};\n\n')
+        out.write('const struct fontFace %s = { %d, %d, %d, 0x%02X, %d, %sGlyphs, %sData };\n' % (
+            name, height, TOP_OFFSET, max_width, first_char, len(entries), name, name))
+        sys.stderr.write('%s: %d glyphs, %d data bytes\n' % (name, len(entries), len(data)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
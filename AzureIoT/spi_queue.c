@@ -0,0 +1,265 @@
+#include "spi_queue.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/gpio.h>
+
+#define SPI_STRUCTS_VERSION 1
+#include <applibs/spi.h>
+
+#define SPI_QUEUE_MAX_ENTRIES 64 /*!< Commands and data blocks that can be queued before the queue submits itself. */
+#define SPI_QUEUE_MAX_TRANSFERS 16 /*!< Transfers submitted by a single SPIMaster_TransferSequential call. */
+
+/**
+* Block of bytes waiting in the queue.
+*/
+struct spiQueueEntry {
+	size_t offset; /**< Position of the bytes in queueBuffer. */
+	size_t length; /**< Number of bytes. */
+	bool isData; /**< True if bytes go to GRAM (mode pin high), false for commands. */
+	int settleUs; /**< Time controller needs after this entry before it accepts anything else. */
+};
+
+static int spiFd = -1; /*!< File descriptor for SPI peripheral. */
+static int modePinFd = -1; /*!< File descriptor for mode selection pin LOW for command, HIGH for data. */
+static int currentMode = -1; /*!< Last value written to mode pin or -1 if unknown. */
+
+static uint8_t queueBuffer[SPI_QUEUE_BUFFER_SIZE]; /*!< Bytes of all queued entries one after another. */
+static size_t queueBufferLength = 0; /*!< Number of used bytes in queueBuffer. */
+static struct spiQueueEntry queue[SPI_QUEUE_MAX_ENTRIES]; /*!< Queued entries in order. */
+static int queueLength = 0; /*!< Number of valid entries in queue. */
+
+static struct timespec readyAt = { 0, 0 }; /*!< Deadline before which controller must not receive anything. */
+
+/**
+* Compares expected number of bytes to be send through SPI with actual number of bytes sent through SPI.
+*
+* @param expectedBytes number of expected bytes to be send through SPI.
+* @param actualBytes number of actual bytes sent through SPI.
+*/
+static bool CheckTransferSize(size_t expectedBytes, ssize_t actualBytes)
+{
+	if (actualBytes < 0)
+		return false;
+
+	if (actualBytes != (ssize_t)expectedBytes)
+		return false;
+
+	return true;
+}
+
+/**
+* Set queue up to use given peripherals. Queue doesn't own them, caller closes them.
+*
+* @param spi File descriptor of opened SPI master.
+* @param modePin File descriptor of mode selection pin opened as output.
+*/
+void initSpiQueue(int spi, int modePin)
+{
+	spiFd = spi;
+	modePinFd = modePin;
+	currentMode = -1;
+	queueBufferLength = 0;
+	queueLength = 0;
+}
+
+/**
+* Sleep until controller is ready, returns immediately if deadline already passed.
+*/
+static void waitUntilReady()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > readyAt.tv_sec || (now.tv_sec == readyAt.tv_sec && now.tv_nsec >= readyAt.tv_nsec))
+		return;
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &readyAt, NULL);
+}
+
+/**
+* Set deadline given amount of microseconds from now.
+*/
+static void scheduleReady(int settleUs)
+{
+	if (settleUs <= 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &readyAt);
+	readyAt.tv_nsec += settleUs * 1000L;
+	if (readyAt.tv_nsec >= 1000000000L)
+	{
+		readyAt.tv_sec++;
+		readyAt.tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+* Set mode pin, skipped if pin already has given value.
+*/
+static int setMode(bool isData)
+{
+	int mode = isData ? GPIO_Value_High : GPIO_Value_Low;
+	if (mode == currentMode)
+		return 0;
+
+	if (GPIO_SetValue(modePinFd, mode) < 0)
+	{
+		currentMode = -1;
+		return -1;
+	}
+
+	currentMode = mode;
+	return 0;
+}
+
+/**
+* Send one batch of entries as a single transfer call.
+*
+* Contiguous bytes are merged into transfers no longer than SPI_MAX_TRANSFER_SIZE.
+*
+* @param first Index of the first entry of the batch.
+* @param count Number of entries in the batch, all of them have the same mode.
+* @return 0 or -1 if something went wrong.
+*/
+static int sendBatch(int first, int count)
+{
+	SPIMaster_Transfer transfers[SPI_QUEUE_MAX_TRANSFERS];
+
+	size_t start = queue[first].offset;
+	size_t end = queue[first + count - 1].offset + queue[first + count - 1].length;
+
+	waitUntilReady();
+
+	if (setMode(queue[first].isData) < 0)
+		return -1;
+
+	while (start < end)
+	{
+		size_t transferCount = (end - start + SPI_MAX_TRANSFER_SIZE - 1) / SPI_MAX_TRANSFER_SIZE;
+		if (transferCount > SPI_QUEUE_MAX_TRANSFERS)
+			transferCount = SPI_QUEUE_MAX_TRANSFERS;
+
+		int result = SPIMaster_InitTransfers(transfers, transferCount);
+		if (result != 0)
+			return -1;
+
+		size_t length = 0;
+		for (size_t i = 0; i < transferCount; i++)
+		{
+			size_t offset = start + i * SPI_MAX_TRANSFER_SIZE;
+			transfers[i].flags = SPI_TransferFlags_Write;
+			transfers[i].writeData = queueBuffer + offset;
+			transfers[i].length = end - offset < SPI_MAX_TRANSFER_SIZE ? end - offset : SPI_MAX_TRANSFER_SIZE;
+			length += transfers[i].length;
+		}
+
+		ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, transfers, transferCount);
+
+		if (!CheckTransferSize(length, transferredBytes))
+			return -1;
+
+		start += length;
+	}
+
+	scheduleReady(queue[first + count - 1].settleUs);
+
+	return 0;
+}
+
+/**
+* Send everything that is queued to the display.
+*
+* Entries are grouped into batches of the same mode. Batch ends after an entry that needs settle time,
+* instead of sleeping right away the deadline is remembered and waited for only if the next batch
+* is ready to go before the controller is.
+*
+* @return 0 or -1 if something went wrong. Queue is empty afterwards either way.
+*/
+int submitSpiQueue()
+{
+	int result = 0;
+	int first = 0;
+	while (first < queueLength && result == 0)
+	{
+		int count = 1;
+		while (first + count < queueLength
+			&& queue[first + count].isData == queue[first].isData
+			&& queue[first + count - 1].settleUs == 0)
+		{
+			count++;
+		}
+
+		result = sendBatch(first, count);
+		first += count;
+	}
+
+	queueLength = 0;
+	queueBufferLength = 0;
+
+	return result;
+}
+
+/**
+* Reserve space for new entry, submits the queue first if it doesn't fit.
+*
+* @return Entry to be filled or NULL if something went wrong.
+*/
+static struct spiQueueEntry *reserveEntry(size_t length, bool isData)
+{
+	if (length == 0 || length > SPI_QUEUE_BUFFER_SIZE)
+		return NULL;
+
+	if (queueLength == SPI_QUEUE_MAX_ENTRIES || queueBufferLength + length > SPI_QUEUE_BUFFER_SIZE)
+	{
+		if (submitSpiQueue() < 0)
+			return NULL;
+	}
+
+	struct spiQueueEntry *entry = &queue[queueLength++];
+	entry->offset = queueBufferLength;
+	entry->length = length;
+	entry->isData = isData;
+	entry->settleUs = 0;
+
+	queueBufferLength += length;
+	return entry;
+}
+
+/**
+* Queue command for the display controller.
+*
+* @param command Command bytes, copied into the queue.
+* @param length Number of bytes in command.
+* @param settleUs Microseconds controller needs to execute the command before it accepts the next one.
+* @return 0 or -1 if something went wrong.
+*/
+int queueSpiCommand(const uint8_t *command, size_t length, int settleUs)
+{
+	struct spiQueueEntry *entry = reserveEntry(length, false);
+	if (entry == NULL)
+		return -1;
+
+	memcpy(queueBuffer + entry->offset, command, length);
+	entry->settleUs = settleUs;
+	return 0;
+}
+
+/**
+* Queue block of data to be written into display GRAM.
+*
+* Returned buffer is filled by the caller in place so pixel data doesn't have to be copied.
+* It is valid until anything else is queued or the queue is submitted.
+*
+* @param length Number of bytes to be written.
+* @return Buffer to be filled with data or NULL if something went wrong.
+*/
+uint8_t *queueSpiData(size_t length)
+{
+	struct spiQueueEntry *entry = reserveEntry(length, true);
+	if (entry == NULL)
+		return NULL;
+
+	return queueBuffer + entry->offset;
+}
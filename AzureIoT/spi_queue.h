@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPI_MAX_TRANSFER_SIZE 4096 /*!< Maximum number of bytes the driver accepts in a single SPI transfer. */
+#define SPI_QUEUE_BUFFER_SIZE (16 * 1024) /*!< Bytes that can be queued before the queue submits itself. */
+
+void initSpiQueue(int spiFd, int modePinFd);
+
+int queueSpiCommand(const uint8_t *command, size_t length, int settleUs);
+uint8_t *queueSpiData(size_t length);
+int submitSpiQueue();
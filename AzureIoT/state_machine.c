@@ -0,0 +1,142 @@
+#include "state_machine.h"
+
+#include <stddef.h>
+
+/**
+* Set machine up in a state, entry hook of the state is not run.
+*
+* @param machine Machine to be set up.
+* @param definition Rules of the machine, have to outlive it.
+* @param state Initial state.
+* @param context Passed to every guard, action and hook.
+*/
+void initStateMachine(struct stateMachine *machine, const struct stateMachineDefinition *definition, int state, void *context)
+{
+	machine->definition = definition;
+	machine->context = context;
+	machine->state = state;
+	machine->traceCount = 0;
+	machine->queueHead = 0;
+	machine->queueTail = 0;
+	machine->isDispatching = false;
+}
+
+static void recordTransition(struct stateMachine *machine, int from, int event, int to)
+{
+	struct stateTraceEntry *entry = &machine->trace[machine->traceCount++ & (STATE_TRACE_SIZE - 1)];
+	clock_gettime(CLOCK_MONOTONIC, &entry->at);
+	entry->from = (uint8_t)from;
+	entry->event = (uint8_t)event;
+	entry->to = (uint8_t)to;
+}
+
+/**
+* Take the transition of an event in the current state.
+*
+* @return 1 if a transition was taken, 0 if the event was ignored or -1 if an action or hook failed.
+*/
+static int handleStateEvent(struct stateMachine *machine, int event, int argument)
+{
+	const struct stateMachineDefinition *definition = machine->definition;
+
+	int from = machine->state;
+	const struct stateRule *rule = &definition->rules[from * definition->eventCount + event];
+	const struct stateTransition *transition = NULL;
+	for (int i = 0; i < rule->count; i++)
+	{
+		if (rule->transitions[i].guard == NULL || rule->transitions[i].guard(machine->context, argument))
+		{
+			transition = &rule->transitions[i];
+			break;
+		}
+	}
+	if (transition == NULL)
+		return 0;
+
+	bool isStay = transition->next == STATE_STAY;
+	int to = isStay ? from : transition->next;
+	recordTransition(machine, from, event, to);
+
+	const struct stateHooks *hooks = definition->hooks;
+	if (!isStay && hooks != NULL && hooks[from].exit != NULL && hooks[from].exit(machine->context) < 0)
+		return -1;
+
+	if (transition->action != NULL && transition->action(machine->context, argument) < 0)
+		return -1;
+
+	if (isStay)
+		return 1;
+
+	machine->state = to;
+	if (hooks != NULL && hooks[to].entry != NULL && hooks[to].entry(machine->context) < 0)
+		return -1;
+
+	return 1;
+}
+
+/**
+* Handle an event in the current state.
+*
+* Rule of the state and event is looked up directly, its transitions are tried in order and the first
+* one whose guard passes is taken: exit hook of the old state, action, entry hook of the new one.
+* Transitions to STATE_STAY only run the action.
+*
+* Events dispatched by guards, actions or hooks are queued and handled in order once the running
+* transition is over, so every transition sees the state it was looked up in.
+*
+* @param machine Machine the event came to.
+* @param event Event number.
+* @param argument Passed to guards and actions, like the key of a key event.
+* @return 1 if the event or an event queued meanwhile caused a transition, 0 if all were ignored or
+*	the event was queued, -1 if an action or hook failed or the queue was full.
+*/
+int dispatchStateEvent(struct stateMachine *machine, int event, int argument)
+{
+	if (event < 0 || event >= machine->definition->eventCount)
+		return 0;
+
+	if (machine->isDispatching)
+	{
+		if (machine->queueHead - machine->queueTail == STATE_QUEUE_SIZE)
+			return -1;
+
+		struct stateQueuedEvent *queued = &machine->queue[machine->queueHead++ & (STATE_QUEUE_SIZE - 1)];
+		queued->event = event;
+		queued->argument = argument;
+		return 0;
+	}
+
+	machine->isDispatching = true;
+	int result = handleStateEvent(machine, event, argument);
+	while (result >= 0 && machine->queueTail != machine->queueHead)
+	{
+		struct stateQueuedEvent queued = machine->queue[machine->queueTail++ & (STATE_QUEUE_SIZE - 1)];
+		int queuedResult = handleStateEvent(machine, queued.event, queued.argument);
+		result = queuedResult < 0 ? -1 : (result > queuedResult ? result : queuedResult);
+	}
+	//events left after a failure belong to a machine in an unknown state
+	machine->queueTail = machine->queueHead;
+	machine->isDispatching = false;
+	return result;
+}
+
+/**
+* Copy recent transitions of the machine.
+*
+* @param machine Machine to read the trace of.
+* @param entries Array to be filled, oldest transition first.
+* @param maxEntries Size of entries.
+* @return Number of entries filled.
+*/
+int getStateTrace(const struct stateMachine *machine, struct stateTraceEntry *entries, int maxEntries)
+{
+	unsigned count = machine->traceCount < STATE_TRACE_SIZE ? machine->traceCount : STATE_TRACE_SIZE;
+	if ((unsigned)maxEntries < count)
+		count = maxEntries;
+
+	unsigned first = machine->traceCount - count;
+	for (unsigned i = 0; i < count; i++)
+		entries[i] = machine->trace[(first + i) & (STATE_TRACE_SIZE - 1)];
+
+	return (int)count;
+}
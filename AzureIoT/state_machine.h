@@ -0,0 +1,90 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef STATE_TRACE_SIZE
+#define STATE_TRACE_SIZE 16 /*!< Number of recent transitions a machine keeps, has to be a power of two. */
+#endif
+
+#ifndef STATE_QUEUE_SIZE
+#define STATE_QUEUE_SIZE 4 /*!< Number of events raised by guards, actions and hooks a machine holds until the running transition is over, has to be a power of two. */
+#endif
+
+#define STATE_STAY (-1) /*!< Next state of a transition that only runs its action, without exit and entry hooks. */
+
+typedef bool (*StateGuardFunction)(void *context, int argument);
+typedef int (*StateActionFunction)(void *context, int argument);
+typedef int (*StateHookFunction)(void *context);
+
+/**
+* Single transition, taken if its guard passes.
+*/
+struct stateTransition {
+	StateGuardFunction guard; /**< Checked before the transition is taken, NULL always passes. */
+	StateActionFunction action; /**< Run between exit of the old state and entry of the new one, may be NULL. */
+	int next; /**< State entered afterwards or STATE_STAY. */
+};
+
+/**
+* Transitions of a state on an event, tried in order until a guard passes.
+*/
+struct stateRule {
+	const struct stateTransition *transitions; /**< First transition, NULL if the event is ignored in the state. */
+	uint8_t count; /**< Number of transitions. */
+};
+
+/**
+* Hooks run when a state is entered or left by a transition to another state.
+*/
+struct stateHooks {
+	StateHookFunction entry; /**< Run after the state became current, may be NULL. */
+	StateHookFunction exit; /**< Run before the state is left, may be NULL. */
+};
+
+/**
+* Constant description of a state machine.
+*/
+struct stateMachineDefinition {
+	int stateCount; /**< States are numbered from 0. */
+	int eventCount; /**< Events are numbered from 0. */
+	const struct stateRule *rules; /**< stateCount * eventCount rules indexed by state * eventCount + event. */
+	const struct stateHooks *hooks; /**< Hooks of every state, NULL if no state has any. */
+};
+
+/**
+* Transition recorded in the trace of a machine.
+*/
+struct stateTraceEntry {
+	struct timespec at; /**< CLOCK_MONOTONIC time of the transition. */
+	uint8_t from; /**< State the event came in. */
+	uint8_t event; /**< Event that caused the transition. */
+	uint8_t to; /**< State afterwards, same as from for STATE_STAY. */
+};
+
+/**
+* Event waiting for the running transition to finish.
+*/
+struct stateQueuedEvent {
+	int event; /**< Event number. */
+	int argument; /**< Passed to guards and actions. */
+};
+
+/**
+* Running instance of a definition.
+*/
+struct stateMachine {
+	const struct stateMachineDefinition *definition; /**< Rules of the machine. */
+	void *context; /**< Passed to every guard, action and hook. */
+	int state; /**< Current state. */
+	struct stateTraceEntry trace[STATE_TRACE_SIZE]; /**< Ring of recent transitions. */
+	unsigned traceCount; /**< Number of transitions ever recorded. */
+	struct stateQueuedEvent queue[STATE_QUEUE_SIZE]; /**< Ring of events dispatched while a transition was running. */
+	unsigned queueHead; /**< Number of events ever queued. */
+	unsigned queueTail; /**< Number of queued events ever handled. */
+	bool isDispatching; /**< True while an event is being handled. */
+};
+
+void initStateMachine(struct stateMachine *machine, const struct stateMachineDefinition *definition, int state, void *context);
+int dispatchStateEvent(struct stateMachine *machine, int event, int argument);
+int getStateTrace(const struct stateMachine *machine, struct stateTraceEntry *entries, int maxEntries);
@@ -0,0 +1,145 @@
+#include "text_field.h"
+
+#include <string.h>
+
+#include "display.h"
+#include "glyph.h"
+
+/**
+* Set text field up, nothing is drawn until text is added.
+*
+* @param field Text field to be set up.
+* @param x Leftmost side of the text.
+* @param y Topmost side of the text.
+* @param color Color of the text.
+* @param backgroundColor Color behind the text, used to erase characters.
+* @param masked Set to true to show every character as '*'.
+*/
+void initTextField(struct textField* field, int x, int y, uint32_t color, uint32_t backgroundColor, bool masked)
+{
+	field->x = x;
+	field->y = y;
+	field->color = color;
+	field->backgroundColor = backgroundColor;
+	field->masked = masked;
+	resetTextField(field);
+}
+
+/**
+* Forget text of the field without drawing anything, use after area of the field was repainted.
+*
+* @param field Text field to be reset.
+*/
+void resetTextField(struct textField* field)
+{
+	field->text[0] = '\0';
+	field->length = 0;
+	field->glyphX[0] = field->x;
+}
+
+/**
+* Set text the field shows without drawing it, use after the text was put on the display some other way.
+*
+* @param field Text field to change.
+* @param text Text already on the display at the position of the field.
+* @return 0 or -1 if text doesn't fit or contains character missing in the font.
+*/
+int assumeTextFieldText(struct textField* field, const char* text)
+{
+	resetTextField(field);
+
+	for (int i = 0; text[i] != '\0'; i++)
+	{
+		const struct fontGlyph *g = getGlyph(field->masked ? '*' : text[i]);
+		if (i == TEXT_FIELD_MAX_LENGTH || g == NULL)
+		{
+			resetTextField(field);
+			return -1;
+		}
+
+		field->text[i] = text[i];
+		field->glyphX[i + 1] = field->glyphX[i] + g->advance;//same spacing as drawText()
+	}
+
+	field->length = strlen(text);
+	field->text[field->length] = '\0';
+
+	return 0;
+}
+
+/**
+* Add character at the end of the text, only the new character is drawn.
+*
+* @param field Text field to add to.
+* @param c Character to be added.
+* @return 0 or -1 if field is full or something went wrong.
+*/
+int appendToTextField(struct textField* field, char c)
+{
+	if (field->length == TEXT_FIELD_MAX_LENGTH)
+		return -1;
+
+	int x = field->glyphX[field->length];
+	int charWidth = drawCharWithBackground(field->masked ? '*' : c, x, field->y, field->color, field->backgroundColor);
+	if (charWidth < 0)
+		return -1;
+
+	field->text[field->length++] = c;
+	field->text[field->length] = '\0';
+	field->glyphX[field->length] = x + charWidth + 2;//same spacing as drawText()
+
+	return 0;
+}
+
+/**
+* Remove last character of the text, only its cell is erased.
+*
+* @param field Text field to remove from.
+* @return 0 or -1 if field is empty or something went wrong.
+*/
+int removeFromTextField(struct textField* field)
+{
+	if (field->length == 0)
+		return -1;
+
+	int startX = field->glyphX[field->length - 1];
+	int width = field->glyphX[field->length] - startX;
+	int result = drawRectangle(startX, field->y - GLYPH_TOP_OFFSET, width - 1, GLYPH_HEIGHT - 1, field->backgroundColor, true, field->backgroundColor);
+	if (result < 0)
+		return -1;
+
+	field->text[--field->length] = '\0';
+
+	return 0;
+}
+
+/**
+* Change text of the field.
+*
+* Characters shared with the beginning of current text are kept, the rest is erased and the
+* new characters are drawn, so typing or deleting one character costs one character.
+*
+* @param field Text field to change.
+* @param text New text.
+* @return 0 or -1 if something went wrong.
+*/
+int setTextFieldText(struct textField* field, const char* text)
+{
+	int common = 0;
+	while (common < field->length && text[common] != '\0' && text[common] == field->text[common])
+		common++;
+
+	while (field->length > common)
+	{
+		if (removeFromTextField(field) < 0)
+			return -1;
+	}
+
+	for (int i = common; text[i] != '\0'; i++)
+	{
+		if (appendToTextField(field, text[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TEXT_FIELD_MAX_LENGTH 24 /*!< Maximum number of characters in a text field, enough for a line across the screen. */
+
+/**
+* Single line of text that is redrawn one character at a time.
+*/
+struct textField {
+	int x; /**< Leftmost side of the text. */
+	int y; /**< Topmost side of the text. */
+	uint32_t color; /**< Color of the text. */
+	uint32_t backgroundColor; /**< Color behind the text. */
+	bool masked; /**< If true every character is shown as '*'. */
+	char text[TEXT_FIELD_MAX_LENGTH + 1]; /**< Text currently on the display. */
+	int length; /**< Number of characters in text. */
+	int glyphX[TEXT_FIELD_MAX_LENGTH + 1]; /**< Leftmost column of every character, glyphX[length] is where next one goes. */
+};
+
+void initTextField(struct textField *field, int x, int y, uint32_t color, uint32_t backgroundColor, bool masked);
+void resetTextField(struct textField *field);
+int assumeTextFieldText(struct textField *field, const char *text);
+
+int appendToTextField(struct textField *field, char c);
+int removeFromTextField(struct textField *field);
+int setTextFieldText(struct textField *field, const char *text);